@@ -0,0 +1,178 @@
+// Compares the arena backends: time per parse and data TLB misses, building the
+// grammar and the ast in the arena under test. TLB misses are only counted on Linux.
+//
+//     onek-cpp-parser-bench [items] [repetitions]
+
+#include "onek/onek-parser.h"
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace bench {
+
+    struct configuration;
+    using F = configuration;
+    using C = onek::composed_parser<F>;
+    using T = onek::terminal_parser<F>;
+    using N = onek::ast_node<F>;
+
+    struct configuration {
+        using V = std::variant<long>;
+        static inline V default_action(N const &node) noexcept {
+            if (node.isTerminal())
+                return {node.token_id_ == onek::token_id::int_number ? std::get<long>(node.value_) : 0};
+            return node.first_child_->action();
+        }
+    };
+
+    F::V sum_action(N const &node) noexcept {
+        long sum = 0;
+        for (N const *child = node.first_child_; child; child = child->next_sibbling_)
+            if (child->token_id_ != onek::token_id::func)
+                sum += std::get<long>(child->action());
+        return {sum};
+    }
+
+    // a list of sums, so that long inputs do not nest deeply
+    onek::arena_ptr<C> grammar(onek::scan_state &scn, onek::arena_handle &handle) {
+        auto the_end = [&scn, &handle]() { return onek::make_arena_ptr<T>(handle, onek::token_id::the_end, [&scn]() -> std::string_view { return scn.is_end() ? "of the story" : std::string_view{}; }); };
+        auto int_number = [&scn, &handle]() { return onek::make_arena_ptr<T>(handle, onek::token_id::int_number, scn, onek::number_format::integer); };
+        auto open = [&scn, &handle]() { return onek::make_arena_ptr<T>(handle, onek::token_id::open, scn, onek::FilterType{"("}); };
+        auto close = [&scn, &handle]() { return onek::make_arena_ptr<T>(handle, onek::token_id::close, scn, onek::FilterType{")"}); };
+        auto plus = [&scn, &handle]() { return onek::make_arena_ptr<T>(handle, onek::token_id::func, scn, onek::FilterType{"+"}); };
+        auto comma = [&scn, &handle]() { return onek::make_arena_ptr<T>(handle, onek::token_id::delimiter, scn, onek::FilterType{","}); };
+        auto p = [&handle](const char *name) { return onek::make_arena_ptr<C>(handle, name, onek::FLAG_PLACEHOLDER | onek::FLAG_ACTION_PARENT); };
+
+        // clang-format off
+        auto factor =           prod( int_number() | (open() > p("sum") >> close())   , "factor");
+        auto sum =              prod( factor >> *(plus() >> factor)                   , sum_action, "sum");
+        auto program =          prod( separated(sum, comma()) >> the_end()            , sum_action, "program");
+        // clang-format on
+
+        onek::wire_placeholders<F>(program.get(), true);
+        return program;
+    }
+
+    // data TLB read misses of the calling thread, -1 if they cannot be counted
+    class tlb_counter {
+        int fd_ = -1;
+
+        public:
+        tlb_counter() {
+#if defined(__linux__)
+            perf_event_attr attr{};
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            fd_ = int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+            if (fd_ >= 0) {
+                ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+                ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+            }
+#endif
+        }
+        ~tlb_counter() {
+#if defined(__linux__)
+            if (fd_ >= 0)
+                close(fd_);
+#endif
+        }
+        long long misses() const {
+#if defined(__linux__)
+            long long count = 0;
+            if (fd_ >= 0 && read(fd_, &count, sizeof(count)) == sizeof(count))
+                return count;
+#endif
+            return -1;
+        }
+    };
+
+    struct result {
+        std::chrono::nanoseconds time{};
+        long long tlb_misses = 0;
+        bool ok = true;
+    };
+
+    result run(onek::arena_backend backend, std::string const &text, int repetitions) {
+        auto scn = onek::scan_state(text);
+        auto handle = onek::arena_handle(backend);
+        auto program = grammar(scn, handle);
+
+        result r;
+        auto tlb = tlb_counter();
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < repetitions; ++i) {
+            auto nodes = onek::arena_handle(backend);
+            nodes.set_destroy_arena_on_scope_exit();
+            scn.reset(text);
+            scn.ast_memory_ = nodes.resource();
+            auto ast = program->parse(scn, nullptr, false);
+            r.ok = r.ok && ast;
+            // the ast must be gone before its arena
+        }
+        r.time = std::chrono::steady_clock::now() - start;
+        r.tlb_misses = tlb.misses();
+        return r;
+    }
+
+    void report(char const *name, unsigned threads, std::vector<result> const &results, int repetitions) {
+        std::chrono::nanoseconds time{};
+        long long misses = 0;
+        bool ok = true;
+        for (auto const &r : results) {
+            time = std::max(time, r.time);
+            misses = r.tlb_misses < 0 || misses < 0 ? -1 : misses + r.tlb_misses;
+            ok = ok && r.ok;
+        }
+        auto parses = double(repetitions) * threads;
+        std::cout << std::left << std::setw(12) << name << std::setw(9) << threads
+                  << std::setw(16) << std::fixed << std::setprecision(2) << parses / std::chrono::duration<double>(time).count()
+                  << std::setw(18);
+        if (misses < 0)
+            std::cout << "n/a";
+        else
+            std::cout << misses / parses;
+        std::cout << (ok ? "" : "PARSE FAILED") << '\n';
+    }
+}
+
+int main(int argc, char **argv) {
+    int items = argc > 1 ? std::atoi(argv[1]) : 20000;
+    int repetitions = argc > 2 ? std::atoi(argv[2]) : 10;
+
+    std::string text;
+    for (int i = 0; i < items; ++i)
+        text += (i ? ", " : "") + std::to_string(i) + " + (1 + 2) + 3";
+
+    std::cout << std::left << std::setw(12) << "backend" << std::setw(9) << "threads"
+              << std::setw(16) << "parses/s" << std::setw(18) << "dTLB misses/parse" << '\n';
+
+    using onek::arena_backend;
+    for (auto [name, backend] : {std::pair{"heap", arena_backend::heap}, std::pair{"huge_pages", arena_backend::huge_pages}})
+        bench::report(name, 1, {bench::run(backend, text, repetitions)}, repetitions);
+
+    unsigned threads = std::max(2u, std::thread::hardware_concurrency());
+    for (auto [name, backend] : {std::pair{"heap", arena_backend::heap}, std::pair{"per_thread", arena_backend::per_thread}}) {
+        std::vector<bench::result> results(threads);
+        {
+            std::vector<std::jthread> pool;
+            for (unsigned t = 0; t < threads; ++t)
+                pool.emplace_back([&, t, backend = backend]() { results[t] = bench::run(backend, text, repetitions); });
+        }
+        bench::report(name, threads, results, repetitions);
+    }
+}
@@ -0,0 +1,96 @@
+// Compares the parse speed of a grammar, its frozen form and the optimized
+// frozen form, and prints what the optimizer did.
+//
+//     onek-cpp-parser-grammar-bench [items] [repetitions]
+
+#include "onek/onek-parser.h"
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+namespace bench {
+
+    struct configuration;
+    using F = configuration;
+    using C = onek::composed_parser<F>;
+    using T = onek::terminal_parser<F>;
+    using N = onek::ast_node<F>;
+
+    struct configuration {
+        using V = std::variant<long>;
+        static inline V default_action(N const &node) noexcept {
+            if (node.isTerminal())
+                return {node.token_id_ == onek::token_id::int_number ? std::get<long>(node.value_) : 0};
+            return node.first_child_->action();
+        }
+    };
+
+    F::V sum_action(N const &node) noexcept {
+        long sum = 0;
+        for (N const *child = node.first_child_; child; child = child->next_sibbling_)
+            if (child->token_id_ != onek::token_id::func)
+                sum += std::get<long>(child->action());
+        return {sum};
+    }
+
+    F::V last_child_action(N const &node) noexcept { return node.last_child_->action(); }
+
+    // a list of sums of calls, written the way grammars usually are:
+    // operators as alternatives of single literals, calls with a common prefix
+    onek::arena_ptr<C> grammar(onek::scan_state &scn) {
+        auto handle = onek::arena_handle();
+        auto the_end = [&scn, &handle]() { return onek::make_arena_ptr<T>(handle, onek::token_id::the_end, [&scn]() -> std::string_view { return scn.is_end() ? "of the story" : std::string_view{}; }); };
+        auto int_number = [&scn, &handle]() { return onek::make_arena_ptr<T>(handle, onek::token_id::int_number, scn, onek::number_format::integer); };
+        auto literal = [&scn, &handle](onek::token_id id, char const *l) { return onek::make_arena_ptr<T>(handle, id, scn, onek::FilterType{l}); };
+        auto op = [&](char const *l) { return literal(onek::token_id::func, l); };
+        auto name = [&]() { return literal(onek::token_id::func, "f"); };
+
+        // clang-format off
+        auto call =             prod( (name() >> literal(onek::token_id::open, "(") >> int_number() >> literal(onek::token_id::close, ")"))
+                                    | (name() >> literal(onek::token_id::open, "[") >> int_number() >> literal(onek::token_id::close, "]"))
+                                    | (name() >> literal(onek::token_id::open, "{") >> int_number() >> literal(onek::token_id::close, "}"))
+                                    | int_number()                                    , last_child_action, "call");
+        auto sum =              prod( call >> *((op("+") | op("-") | op("*") | op("/") | op("%") | op("^")) >> call), sum_action, "sum");
+        auto program =          prod( separated(sum, literal(onek::token_id::delimiter, ",")) >> the_end(), sum_action, "program");
+        // clang-format on
+
+        onek::wire_placeholders<F>(program.get(), true);
+        return program;
+    }
+
+    template<typename P>
+    double parses_per_second(onek::scan_state &scn, std::string const &text, int repetitions, P &&parse) {
+        bool ok = true;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < repetitions; ++i) {
+            scn.reset(text);
+            ok = ok && parse();
+        }
+        std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+        if (!ok)
+            std::cout << "PARSE FAILED\n";
+        return repetitions / time.count();
+    }
+}
+
+int main(int argc, char **argv) {
+    int items = argc > 1 ? std::atoi(argv[1]) : 20000;
+    int repetitions = argc > 2 ? std::atoi(argv[2]) : 10;
+
+    char const *ops[] = {"+", "-", "*", "/", "%", "^"};
+    std::string text;
+    for (int i = 0; i < items; ++i)
+        text += (i ? ", " : "") + std::to_string(i) + " " + ops[i % 6] + " f{1} " + ops[(i + 1) % 6] + " f[2]";
+
+    auto scn = onek::scan_state(text);
+    auto program = bench::grammar(scn);
+    auto frozen = onek::frozen_grammar<bench::F>(program.get());
+    auto optimized = frozen;
+    std::cout << onek::optimize(optimized) << '\n';
+
+    std::cout << std::left << std::setw(12) << "grammar" << "parses/s\n" << std::fixed << std::setprecision(2);
+    std::cout << std::setw(12) << "pointers" << bench::parses_per_second(scn, text, repetitions, [&]() { return program->recognize(scn, false); }) << '\n';
+    std::cout << std::setw(12) << "frozen" << bench::parses_per_second(scn, text, repetitions, [&]() { return frozen.recognize(scn, false); }) << '\n';
+    std::cout << std::setw(12) << "optimized" << bench::parses_per_second(scn, text, repetitions, [&]() { return optimized.recognize(scn, false); }) << '\n';
+}
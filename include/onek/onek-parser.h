@@ -2,5 +2,18 @@
 
 #include "../../src/arena_ptr.h"
 #include "../../src/ast.h"
+#include "../../src/ast_index.h"
+#include "../../src/batch.h"
+#include "../../src/bracket_index.h"
+#include "../../src/frozen_grammar.h"
+#include "../../src/grammar_optimizer.h"
+#include "../../src/hash_cons.h"
+#include "../../src/incremental.h"
+#include "../../src/lexer.h"
+#include "../../src/parallel_parse.h"
+#include "../../src/parse_events.h"
 #include "../../src/parser_combinators.h"
 #include "../../src/placeholders.h"
+#include "../../src/push_parser.h"
+#include "../../src/sentence_generator.h"
+#include "../../src/symbol_table.h"
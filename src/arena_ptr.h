@@ -1,16 +1,157 @@
 #pragma once
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <memory_resource>
+#include <new>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
 
 namespace onek {
 
+    enum class arena_backend {
+        heap,      // upstream memory from the default allocator
+        huge_pages,// upstream memory in 2 MB huge pages, fewer TLB misses for large grammars and asts
+        per_thread // blocks are recycled by the thread that releases them, for building grammars and asts on several threads at once
+    };
+
     namespace detail {
 
+        // Hands out multiples of 2 MB aligned to 2 MB. Explicit huge pages are
+        // used if the system has reserved some, otherwise transparent huge pages
+        // are requested. Elsewhere than on Linux this is plain aligned new.
+        class huge_page_resource : public std::pmr::memory_resource {
+            static constexpr size_t page_size = size_t(2) << 20;
+            static size_t round_up(size_t bytes) noexcept { return (bytes + page_size - 1) / page_size * page_size; }
+
+            void *do_allocate(size_t bytes, [[maybe_unused]] size_t alignment) override {
+                size_t size = round_up(bytes);
+#if defined(__linux__)
+                void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+                if (p != MAP_FAILED)
+                    return p;
+                // over-allocate and trim, so that the region is aligned to a huge page
+                auto *raw = static_cast<char *>(mmap(nullptr, size + page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+                if (raw == MAP_FAILED)
+                    throw std::bad_alloc();
+                auto offset = reinterpret_cast<uintptr_t>(raw) % page_size;
+                char *aligned = raw + (offset ? page_size - offset : 0);
+                if (aligned != raw)
+                    munmap(raw, aligned - raw);
+                if (size_t tail = raw + size + page_size - (aligned + size))
+                    munmap(aligned + size, tail);
+                madvise(aligned, size, MADV_HUGEPAGE);
+                return aligned;
+#else
+                return ::operator new(size, std::align_val_t(std::max(alignment, page_size)));
+#endif
+            }
+
+            void do_deallocate(void *p, size_t bytes, [[maybe_unused]] size_t alignment) override {
+#if defined(__linux__)
+                munmap(p, round_up(bytes));
+#else
+                ::operator delete(p, std::align_val_t(std::max(alignment, page_size)));
+#endif
+            }
+
+            [[nodiscard]] bool do_is_equal(std::pmr::memory_resource const &other) const noexcept override { return this == &other; }
+        };
+
+        // The blocks an arena gives back are kept by the thread that releases
+        // the arena and handed to the next arena that thread creates, so that
+        // threads that build one ast after another rarely go to the global heap.
+        // Blocks are plain aligned new, any thread may release any of them.
+        class thread_block_cache {
+            struct block {
+                void *p;
+                size_t bytes;
+                size_t alignment;
+            };
+            static constexpr size_t max_blocks = 4;
+            std::vector<block> blocks_;
+
+            public:
+            ~thread_block_cache() {
+                for (auto const &b : blocks_)
+                    ::operator delete(b.p, b.bytes, std::align_val_t(b.alignment));
+            }
+            void *allocate(size_t bytes, size_t alignment) {
+                auto it = std::find_if(blocks_.begin(), blocks_.end(), [&](block const &b) { return b.bytes == bytes && b.alignment == alignment; });
+                if (it == blocks_.end())
+                    return ::operator new(bytes, std::align_val_t(alignment));
+                void *p = it->p;
+                blocks_.erase(it);
+                return p;
+            }
+            void deallocate(void *p, size_t bytes, size_t alignment) {
+                if (blocks_.size() < max_blocks)
+                    blocks_.push_back({p, bytes, alignment});
+                else
+                    ::operator delete(p, bytes, std::align_val_t(alignment));
+            }
+        };
+
+        // upstream of per thread arenas, uses the cache of the calling thread
+        class per_thread_resource : public std::pmr::memory_resource {
+            static thread_block_cache &cache() {
+                static thread_local thread_block_cache c;
+                return c;
+            }
+            void *do_allocate(size_t bytes, size_t alignment) override { return cache().allocate(bytes, alignment); }
+            void do_deallocate(void *p, size_t bytes, size_t alignment) override { cache().deallocate(p, bytes, alignment); }
+            [[nodiscard]] bool do_is_equal(std::pmr::memory_resource const &other) const noexcept override {
+                return dynamic_cast<per_thread_resource const *>(&other) != nullptr;
+            }
+        };
+
+        inline std::unique_ptr<std::pmr::memory_resource> make_upstream(arena_backend backend) {
+            switch (backend) {
+                case arena_backend::huge_pages: return std::make_unique<huge_page_resource>();
+                case arena_backend::per_thread: return std::make_unique<per_thread_resource>();
+                default: return nullptr;
+            }
+        }
+
+        // counts the bytes of the blocks an arena holds
+        class counting_resource : public std::pmr::memory_resource {
+            std::pmr::memory_resource *upstream_;
+            size_t bytes_ = 0;
+
+            void *do_allocate(size_t bytes, size_t alignment) override {
+                void *p = upstream_->allocate(bytes, alignment);
+                bytes_ += bytes;
+                return p;
+            }
+            void do_deallocate(void *p, size_t bytes, size_t alignment) override {
+                upstream_->deallocate(p, bytes, alignment);
+                bytes_ -= bytes;
+            }
+            [[nodiscard]] bool do_is_equal(std::pmr::memory_resource const &other) const noexcept override { return this == &other; }
+
+            public:
+            explicit counting_resource(std::pmr::memory_resource *upstream) noexcept : upstream_(upstream) {}
+            [[nodiscard]] size_t bytes() const noexcept { return bytes_; }
+        };
+
         struct arena {
             static inline constexpr size_t MIN_SIZE = 10000000;
-            std::pmr::monotonic_buffer_resource mbr{MIN_SIZE};
+            std::unique_ptr<std::pmr::memory_resource> upstream_;// nullptr for the default resource
+            counting_resource reserved_;
+            std::pmr::monotonic_buffer_resource mbr;
             std::pmr::polymorphic_allocator<std::byte> pa{&mbr};
+            size_t bytes_ = 0;// allocated by make_arena_ptr
+
+            explicit arena(arena_backend backend = arena_backend::heap)
+                : upstream_(make_upstream(backend)),
+                  reserved_(upstream_ ? upstream_.get() : std::pmr::get_default_resource()),
+                  mbr(MIN_SIZE, &reserved_) {
+            }
         };
 
         class ptr_base {
@@ -21,12 +162,22 @@ namespace onek {
     }
 
     template<typename> class arena_ptr;
+    class resource_guard;
 
     class arena_handle {
         detail::arena *arena_ = nullptr;
+        arena_backend backend_ = arena_backend::heap;
         bool destroy_arena_ = false;
+
+        detail::arena *get() {
+            if (!arena_)
+                arena_ = new detail::arena(backend_);
+            return arena_;
+        }
+
         public:
         arena_handle() = default;
+        explicit arena_handle(arena_backend backend) : backend_(backend) {}
         explicit arena_handle(detail::ptr_base const &p) : arena_(p.arena_){};
         ~arena_handle () {
             if (arena_ && destroy_arena_) {
@@ -35,11 +186,19 @@ namespace onek {
             }
         }
         void set_destroy_arena_on_scope_exit() {destroy_arena_ = true;}
+        [[nodiscard]] size_t bytes() const noexcept { return arena_ ? arena_->bytes_ : 0; }
+        // the blocks the arena holds, grammar objects and everything allocated from resource()
+        [[nodiscard]] size_t reserved_bytes() const noexcept { return arena_ ? arena_->reserved_.bytes() : 0; }
+
+        // for containers that allocate from the arena, e.g. the nodes of an ast,
+        // see scan_state::ast_memory_. The memory is released with the arena only.
+        std::pmr::memory_resource *resource() { return &get()->mbr; }
 
         template<typename T, typename... Args>
         friend arena_ptr<T> make_arena_ptr(arena_handle &, Args &&...);
         template<typename T>
         friend arena_ptr<T> make_arena_ptr(arena_handle &, T const &);
+        friend resource_guard;
     };
 
     template<typename T>
@@ -72,19 +231,17 @@ namespace onek {
 
     template<typename T>
     arena_ptr<T> make_arena_ptr(arena_handle &handle, T const &other) {
-        auto &a = handle.arena_;
-        if (!a)
-            a = new detail::arena;
+        auto *a = handle.get();
         T *value = a->pa.new_object<T>(other);
+        a->bytes_ += sizeof(T);
         return arena_ptr(a, value);
     }
 
     template<typename T, typename... Args>
     arena_ptr<T> make_arena_ptr(arena_handle &handle, Args &&...args) {
-        auto &a = handle.arena_;
-        if (!a)
-            a = new detail::arena;
+        auto *a = handle.get();
         T *value = a->pa.new_object<T>(std::forward<Args>(args)...);
+        a->bytes_ += sizeof(T);
         return arena_ptr(a, value);
     }
 }
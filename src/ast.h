@@ -3,13 +3,19 @@
 #include "ast_graph.h"
 #include "ast_node.h"
 #include "error_messages.h"
+#include "parse_events.h"
 #include "status_saver_template.h"
 #include "token.h"
 #include <deque>
+#include <fstream>
 #include <functional>
 #include <memory>
+#include <memory_resource>
 #include <stack>
+#include <string>
 #include <string_view>
+#include <utility>
+#include <vector>
 
 namespace onek {
 
@@ -17,15 +23,80 @@ namespace onek {
     struct ast {
         //using V = F::V;
         using N = ast_node<F>;
-        std::deque<ast_node<F>> memory_; // Container may not invalidate iterators (vector would crash)
+        std::pmr::deque<ast_node<F>> memory_; // Container may not invalidate iterators (vector would crash)
+        std::shared_ptr<std::string const> text_;// the text the token strings point into, if owned by the tree
+        std::vector<ast> parts_;// trees joined under the root of this one, see join
+        bool hash_consed_ = false;// identical subtrees are known, execute caches pure actions
+
+        parse_mode mode_ = parse_mode::tree;
+        parse_events const *events_ = nullptr;
+        std::vector<parse_event> pending_;// events not yet delivered, see choice_point
+        size_t choice_points_ = 0;
+
+        explicit ast(std::pmr::memory_resource *memory = nullptr, parse_mode mode = parse_mode::tree, parse_events const *events = nullptr)
+            : memory_(memory ? memory : std::pmr::get_default_resource()), mode_(mode), events_(events) {
+        }
+
+        // Marks a part of the parse whose failure is not the failure of the
+        // whole parse, i.e. an alternative that is not the last one or a
+        // repetition that is not required. Events are held back as long as
+        // a choice point is open, because backtracking may take them back.
+        // Outside of choice points a failure fails the whole parse, so
+        // events are delivered at once and memory is bounded by the longest
+        // choice point, not by the input.
+        struct choice_point {
+            ast &a;
+            explicit choice_point(ast &a) noexcept : a(a) { a.open_choice(); }
+            ~choice_point() { a.close_choice(); }
+        };
+        void open_choice() noexcept { ++choice_points_; }
+        void close_choice() {
+            if (!--choice_points_)
+                deliver();
+        }
+
+        // delivers the events that can not be taken back anymore
+        void deliver() {
+            if (choice_points_ || pending_.empty())
+                return;
+            for (auto const &e : pending_)
+                e.deliver(*events_);
+            pending_.clear();
+        }
+
+        // called when a composed production matched, the counterpart of add_node
+        void end_node(char const *name) {
+            if (mode_ == parse_mode::events && is_named_production(name)) {
+                pending_.push_back({parse_event_kind::exit, token_id::composed, name, {}, {}});
+                deliver();
+            }
+        }
+
+        // keeps the parsed text alive as long as the tree, for texts that do not outlive the parse
+        void adopt(std::shared_ptr<std::string const> text) noexcept { text_ = std::move(text); }
 
         // todo: remove name parameter and guess it later on
-        N *add_node(N::action_function action, token_id id, const char *name, N *parent_node, std::string_view const &tokenstr, unsigned short flags = FLAG_NONE) noexcept {
+        N *add_node(N::action_function action, token_id id, const char *name, N *parent_node, std::string_view const &tokenstr, unsigned short flags = FLAG_NONE, token_value value = {}) noexcept {
+
+            // no nodes in the other modes, children are parsed with a null parent
+            if (mode_ != parse_mode::tree) {
+                if (mode_ == parse_mode::events && (id != token_id::composed || is_named_production(name))) {
+                    pending_.push_back({id == token_id::composed ? parse_event_kind::enter : parse_event_kind::token, id, name, tokenstr, std::move(value)});
+                    deliver();
+                }
+                return nullptr;
+            }
+
+            // Only action parents and terminals are stored. The children of any
+            // other production end up under the nearest action parent, so that
+            // one stands in for it; the call stack of the parse keeps the nesting.
+            if (id == token_id::composed && !(FLAG_ACTION_PARENT & flags) && parent_node)
+                return parent_node;
 
             // mark nodes that are roots of a bracketed expression. This is only for
             // pretty printing the ast in to a grapviz file.
             auto xxx = parent_node;
-            if (id == token_id::open) {//todo: rename id which is different from graph disambiguation id
+            if (id == token_id::open) {
                 while (xxx) {
                     if (xxx->flags & FLAG_ACTION_PARENT) {
                         xxx->tokenstr = "(...)";
@@ -36,7 +107,7 @@ namespace onek {
             }
 
             // store the node in an arena
-            memory_.emplace_back(N{action, id, tokenstr, name, flags, parent_node});
+            memory_.emplace_back(N{action, id, tokenstr, value, name, flags, parent_node});
 
             // add it to a parent node that is also bound to an action such that the
             // tree is flattened in a way that actions can be implemented by traversing
@@ -44,14 +115,12 @@ namespace onek {
             // and vice versa to get right associativity.
             N *added_node = &memory_.back();
 
-            if (id == token_id::open || id == token_id::close)
+            if (id == token_id::open || id == token_id::close || id == token_id::delimiter)
                 return added_node;
 
             if (id == token_id::composed && !(FLAG_ACTION_PARENT & flags)) {
-                if (!parent_node) {
-                    added_node->flags |= FLAG_ACTION_PARENT;
-                    added_node->name_ = "start";
-                }
+                added_node->flags |= FLAG_ACTION_PARENT;
+                added_node->name_ = "start";
                 return added_node;
             }
 
@@ -65,16 +134,31 @@ namespace onek {
             return added_node;
         }
 
-        void print_node(ast_graph &graph, N *n) {
-            for (N *child = n->first_child_; child != nullptr; child = child->next_sibbling_)
-                graph.add_edge(n->name_, n->id, child->name_, child->tokenstr, child->id);
-            for (N *child = n->first_child_; child != nullptr; child = child->next_sibbling_)
-                print_node(graph, child);
+        // one tree with a new root whose children are the roots of parts, in order.
+        // Moving a deque does not move its nodes, so the links stay valid.
+        static ast join(std::vector<ast> parts, N::action_function action, char const *name) {
+            ast a;
+            N *root = a.add_node(std::move(action), token_id::composed, name, nullptr, std::string_view{}, FLAG_ACTION_PARENT);
+            for (auto &part : parts) {
+                N *part_root = part.get_root_node();
+                part_root->parent_ = root;
+                root->add_child(part_root);
+            }
+            a.parts_ = std::move(parts);
+            return a;
+        }
+
+        export_result write_graphviz(std::ostream &os, export_limits const &limits = {}) {
+            return onek::write_graphviz(os, get_root_node(), limits);
+        }
+
+        export_result write_json(std::ostream &os, export_limits const &limits = {}) {
+            return onek::write_json(os, get_root_node(), limits);
         }
 
         void create_ast_graphviz_file(char const *file_name) {
-            ast_graph graph(file_name);
-            print_node(graph, get_root_node());
+            std::ofstream file(file_name);
+            write_graphviz(file, {});
         }
 
         N *get_root_node() noexcept {
@@ -84,10 +168,19 @@ namespace onek {
                 x = x->parent_;
             return x;
         }
+        N const *get_root_node() const noexcept {
+            N const *x = &memory_.front();
+            while (x->parent_)
+                x = x->parent_;
+            return x;
+        }
 
         F::V execute() noexcept {
             N const *start = get_root_node();
+            typename N::execution_cache cache;
+            auto *outer = std::exchange(N::active_cache_, hash_consed_ ? &cache : nullptr);
             auto result = start->action();
+            N::active_cache_ = outer;
             log::log_result(result);
             return {result};
         }
@@ -97,27 +190,51 @@ namespace onek {
     // as the non-specialized version. It exists purely to optimize away expensive
     // copying of the ast::memory_ arena.
     // To understand the following code note, that ast_nodes are values but these
-    // values are contained in an intrusive list, hence these values are also entities
+    // values are contained in an intrusive list, hence these values are also entities.
+    // New nodes are attached to the nearest action parent, so that is the node
+    // whose child list has to be truncated, not necessarily the direct parent.
     //
     // todo: find another solution. Its not clear that this is a specialisation. Maybe it
     // should simply be an independent class of its own?
     template<typename F>
     class status_saver<ast<F>> {
         using N = ast_node<F>;
-        const N backup_;
-        N *original_;
+        N *owner_ = nullptr;// the action parent new children are attached to
+        N *last_child_ = nullptr;
+        std::string_view tokenstr_;
         size_t vector_size_;
+        size_t events_size_;
 
         public:
         status_saver(ast<F> const &tree, N *parent) noexcept
-            : backup_(parent ? *parent : N{}), original_(parent ? parent : nullptr), vector_size_(tree.memory_.size()) {
+            : vector_size_(tree.memory_.size()), events_size_(tree.pending_.size()) {
+            while (parent && !(parent->flags & FLAG_ACTION_PARENT))
+                parent = parent->parent_;
+            if (parent) {
+                owner_ = parent;
+                last_child_ = parent->last_child_;
+                tokenstr_ = parent->tokenstr;
+            }
         }
         void restore_to(ast<F> &tree) const noexcept {
-            if (!tree.memory_.empty() && vector_size_ > 0 && vector_size_ < tree.memory_.size())// to-do - we could use guarantees
-                tree.memory_.erase(tree.memory_.begin() + vector_size_);
-
-            if (original_)
-                *original_ = backup_;
+            // nodes are only ever appended, so everything created since the
+            // status was saved is at the end. Erasing at the end of a deque does
+            // not move the remaining nodes.
+            if (vector_size_ < tree.memory_.size())
+                tree.memory_.erase(tree.memory_.begin() + vector_size_, tree.memory_.end());
+            if (events_size_ < tree.pending_.size())
+                tree.pending_.resize(events_size_);
+
+            // and those of the new nodes that were attached to an existing node
+            // were appended to the child list of the owner
+            if (owner_) {
+                owner_->last_child_ = last_child_;
+                if (last_child_)
+                    last_child_->next_sibbling_ = nullptr;
+                else
+                    owner_->first_child_ = nullptr;
+                owner_->tokenstr = tokenstr_;
+            }
         }
     };
 }
@@ -1,50 +1,146 @@
 #pragma once
 
-#include <map>
-#include <fstream>
-#include <memory>
+#include "token.h"
+#include <cstdint>
+#include <limits>
+#include <ostream>
 #include <string_view>
 #include <vector>
-#include <cstring>
-#include <cassert>
 
 namespace onek {
 
-    static ushort uuid = 0;//todo: put somewhere else
+    // Limits for dumping big trees. Nodes below max_depth are not visited and
+    // the traversal stops after max_nodes nodes. Both cases are reported as truncated.
+    struct export_limits {
+        size_t max_depth = std::numeric_limits<size_t>::max();
+        uint64_t max_nodes = std::numeric_limits<uint64_t>::max();
+    };
 
-    class ast_graph {
-        public:
-        std::map<ushort, std::string> vertices_s;// todo
-        std::map<ushort, ushort> vertices_i;     // todo
-        std::vector<std::pair<ushort, ushort>> edges;
-        std::ofstream file;
+    struct export_result {
+        uint64_t nodes = 0;
+        bool truncated = false;
+    };
 
-        explicit ast_graph(char const *filename) {
-            file.open(filename);
-            file << "digraph {\n";
-        }
+    namespace detail {
+
+        // Preorder traversal of the action tree that streams every node to the
+        // callbacks as soon as it is visited. Only one frame per tree level is kept,
+        // i.e. memory grows with the depth of the tree, not with the number of nodes.
+        // Node ids are assigned in visiting order.
+        template<typename N, typename Enter, typename Leave>
+        export_result walk_ast(N const *root, export_limits const &limits, Enter &&enter, Leave &&leave) {
+            struct frame {
+                N const *node;
+                uint64_t id;
+                N const *next;
+            };
+            std::vector<frame> stack;
+            export_result result;
+
+            auto visit = [&](N const &n, uint64_t parent_id, bool first_child) {
+                uint64_t id = result.nodes++;
+                size_t depth = stack.size();
+                bool expand = n.first_child_ && depth + 1 < limits.max_depth;
+                if (n.first_child_ && !expand)
+                    result.truncated = true;
+                enter(n, id, parent_id, depth, first_child, expand);
+                if (expand)
+                    stack.push_back({&n, id, n.first_child_});
+                else
+                    leave(n, id, false);
+            };
+
+            if (!root || limits.max_nodes == 0)
+                return result;
+            visit(*root, 0, true);
 
-        ~ast_graph() {
-            for (auto const &e : edges) {
-                auto xxx = vertices_s[e.second];
-                file << "    \"" << vertices_s[e.first] << "(" << vertices_i[e.first] << ")\" [label=\"" << vertices_s[e.first] << "\"] ";
-                file << "    \"" << vertices_s[e.second] << "(" << vertices_i[e.second] << ")\" [label=\"" << vertices_s[e.second] << "\"] ";
-                file << "    \"" << vertices_s[e.first] << "(" << vertices_i[e.first] << ")\"";
-                file << " -> ";
-                file << "\"" << vertices_s[e.second] << "(" << vertices_i[e.second] << ")\"\n";
+            while (!stack.empty()) {
+                frame &top = stack.back();
+                if (top.next && result.nodes >= limits.max_nodes) {
+                    result.truncated = true;
+                    top.next = nullptr;
+                }
+                if (!top.next) {
+                    leave(*top.node, top.id, true);
+                    stack.pop_back();
+                    continue;
+                }
+                N const *child = top.next;
+                uint64_t parent_id = top.id;
+                bool first_child = child == top.node->first_child_;
+                top.next = child->next_sibbling_;
+                visit(*child, parent_id, first_child);// may invalidate top
             }
-            file << "}\n";
-            file.close();
+            return result;
         }
 
-        void add_edge(std::string_view parent_name, ushort parent_id, std::string_view child_name, std::string_view info, ushort child_id) {
-            if (vertices_s[parent_id].empty())
-                vertices_s[parent_id] = parent_name;
-            if (vertices_s[child_id].empty())
-                vertices_s[child_id] = std::string(child_name) + "\\n" + std::string(info);
-            vertices_i[parent_id] = parent_id;//   ++counter;
-            vertices_i[child_id] = child_id;  // ++counter;
-            edges.emplace_back(parent_id, child_id);
+        inline void write_escaped(std::ostream &os, std::string_view s, bool json) {
+            static char const hex[] = "0123456789abcdef";
+            for (char c : s) {
+                if (c == '"' || c == '\\')
+                    os << '\\' << c;
+                else if (c == '\n')
+                    os << "\\n";
+                else if (json && static_cast<unsigned char>(c) < 0x20)
+                    os << "\\u00" << hex[(c >> 4) & 0xf] << hex[c & 0xf];
+                else
+                    os << c;
+            }
         }
-    };
+    }
+
+    // Writes the tree below root as a graphviz digraph. Every vertex is labelled
+    // with the production name and the token text.
+    template<typename N>
+    export_result write_graphviz(std::ostream &os, N const *root, export_limits const &limits = {}) {
+        os << "digraph {\n";
+        auto enter = [&os](N const &n, uint64_t id, uint64_t parent_id, size_t depth, bool, bool expand) {
+            os << "    n" << id << " [label=\"";
+            detail::write_escaped(os, n.name_, false);
+            if (!n.tokenstr.empty()) {
+                os << "\\n";
+                detail::write_escaped(os, n.tokenstr, false);
+            }
+            os << '"';
+            if (n.first_child_ && !expand)
+                os << ", style=dashed";
+            os << "]\n";
+            if (depth > 0)
+                os << "    n" << parent_id << " -> n" << id << '\n';
+        };
+        auto leave = [](N const &, uint64_t, bool) {};
+        auto result = detail::walk_ast(root, limits, enter, leave);
+        if (result.truncated)
+            os << "    // truncated after " << result.nodes << " nodes\n";
+        os << "}\n";
+        return result;
+    }
+
+    // Writes the tree below root as nested JSON objects:
+    // {"root":{"id":0,"name":"..","token":"..","text":"..","children":[...]},"nodes":n,"truncated":false}
+    template<typename N>
+    export_result write_json(std::ostream &os, N const *root, export_limits const &limits = {}) {
+        os << "{\"root\":";
+        auto enter = [&os](N const &n, uint64_t id, uint64_t, size_t, bool first_child, bool expand) {
+            if (!first_child)
+                os << ',';
+            os << "{\"id\":" << id << ",\"name\":\"";
+            detail::write_escaped(os, n.name_, true);
+            os << "\",\"token\":\"" << token_to_string(n.token_id_) << "\",\"text\":\"";
+            detail::write_escaped(os, n.tokenstr, true);
+            os << '"';
+            if (n.first_child_ && !expand)
+                os << ",\"truncated\":true";
+            if (expand)
+                os << ",\"children\":[";
+        };
+        auto leave = [&os](N const &, uint64_t, bool expanded) {
+            os << (expanded ? "]}" : "}");
+        };
+        auto result = detail::walk_ast(root, limits, enter, leave);
+        if (result.nodes == 0)
+            os << "null";
+        os << ",\"nodes\":" << result.nodes << ",\"truncated\":" << (result.truncated ? "true" : "false") << "}\n";
+        return result;
+    }
 }
@@ -0,0 +1,173 @@
+#pragma once
+
+#include "ast.h"
+#include "ast_node.h"
+#include "token.h"
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace onek {
+
+    // e.g. {.production = "term", .under = "expression", .containing = token_id::func, .text = "/"}
+    struct ast_query {
+        std::string_view production{};     // nodes with this name
+        std::string_view under{};          // that have an ancestor with this name, if not empty
+        std::optional<token_id> containing{};// and a terminal of this token in their subtree
+        std::string_view text{};           // with this text, if not empty
+    };
+
+    // Secondary indexes over a parsed tree, built once in one traversal.
+    // Nodes are numbered in depth first order, so that the subtree of a node
+    // is the range of numbers [number, end) and ancestry is two comparisons.
+    // Queries then work on the sorted lists of the nodes of a name or token.
+    // The tree must neither change nor be destroyed while the index is used.
+    template<typename F>
+    class ast_index {
+        using N = ast_node<F>;
+
+        std::string_view text_;
+        std::vector<N const *> nodes_;// in depth first order
+        std::vector<uint32_t> end_;   // end of the subtree of each node
+        std::vector<uint32_t> parent_;
+        std::vector<char const *> begin_, last_;// source extent of each node, nullptr if it has no terminal
+        std::unordered_map<N const *, uint32_t> number_;
+        std::unordered_map<std::string_view, std::vector<uint32_t>> by_name_;
+        std::unordered_map<token_id, std::vector<uint32_t>> by_token_;
+        std::vector<uint32_t> by_begin_;// nodes with an extent, the begins are ascending in depth first order
+
+        std::vector<N const *> to_nodes(std::span<uint32_t const> numbers) const {
+            std::vector<N const *> result;
+            result.reserve(numbers.size());
+            for (uint32_t i : numbers)
+                result.push_back(nodes_[i]);
+            return result;
+        }
+
+        std::span<uint32_t const> lookup(auto const &index, auto const &key) const noexcept {
+            auto it = index.find(key);
+            return it == index.end() ? std::span<uint32_t const>{} : std::span<uint32_t const>(it->second);
+        }
+
+        public:
+        // text is the text the tree was parsed from, for the offsets
+        ast_index(ast<F> const &a, std::string_view text) : text_(text) {
+            struct frame {
+                N const *node;
+                uint32_t parent;
+                bool children_done;
+            };
+            std::vector<frame> todo{{a.get_root_node(), UINT32_MAX, false}};
+            while (!todo.empty()) {
+                auto [n, parent, children_done] = todo.back();
+                todo.pop_back();
+                if (children_done) {
+                    // the extent of a node spans the extents of its children
+                    uint32_t i = number_.at(n);
+                    end_[i] = uint32_t(nodes_.size());
+                    for (uint32_t c = i + 1; c < end_[i]; c = end_[c]) {
+                        if (!begin_[c])
+                            continue;
+                        if (!begin_[i])
+                            begin_[i] = begin_[c];
+                        last_[i] = last_[c];
+                    }
+                    continue;
+                }
+                auto i = uint32_t(nodes_.size());
+                nodes_.push_back(n);
+                end_.push_back(0);
+                parent_.push_back(parent);
+                bool const has_text = n->isTerminal() && !n->tokenstr.empty() && n->token_id_ != token_id::the_end;
+                begin_.push_back(has_text ? n->tokenstr.data() : nullptr);
+                last_.push_back(has_text ? n->tokenstr.data() + n->tokenstr.size() : nullptr);
+                number_.emplace(n, i);
+                by_name_[n->name_].push_back(i);
+                if (n->isTerminal())
+                    by_token_[n->token_id_].push_back(i);
+
+                todo.push_back({n, parent, true});
+                for (N const *c = n->last_child_; c; c = c->prev_sibbling_)
+                    todo.push_back({c, i, false});
+            }
+            for (uint32_t i = 0; i < nodes_.size(); ++i)
+                if (begin_[i])
+                    by_begin_.push_back(i);
+        }
+
+        [[nodiscard]] std::vector<N const *> named(std::string_view name) const { return to_nodes(lookup(by_name_, name)); }
+        [[nodiscard]] std::vector<N const *> tokens(token_id id) const { return to_nodes(lookup(by_token_, id)); }
+
+        [[nodiscard]] bool is_ancestor(N const *ancestor, N const *node) const {
+            uint32_t a = number_.at(ancestor), n = number_.at(node);
+            return a < n && n < end_[a];
+        }
+
+        [[nodiscard]] N const *parent(N const *node) const {
+            uint32_t p = parent_[number_.at(node)];
+            return p == UINT32_MAX ? nullptr : nodes_[p];
+        }
+
+        // source offsets [begin, end) of the terminals of a node
+        [[nodiscard]] std::pair<size_t, size_t> extent(N const *node) const {
+            uint32_t i = number_.at(node);
+            if (!begin_[i])
+                return {0, 0};
+            return {size_t(begin_[i] - text_.data()), size_t(last_[i] - text_.data())};
+        }
+
+        // the innermost node whose extent contains the offset, nullptr if there is none
+        [[nodiscard]] N const *at(size_t offset) const {
+            char const *p = text_.data() + offset;
+            auto it = std::upper_bound(by_begin_.begin(), by_begin_.end(), p, [this](char const *p, uint32_t i) { return p < begin_[i]; });
+            if (it == by_begin_.begin())
+                return nullptr;
+            // the last node that begins before, or one of its ancestors
+            for (uint32_t i = *std::prev(it); i != UINT32_MAX; i = parent_[i])
+                if (begin_[i] && p < last_[i])
+                    return nodes_[i];
+            return nullptr;
+        }
+
+        [[nodiscard]] std::vector<N const *> find(ast_query const &q) const {
+            auto candidates = lookup(by_name_, q.production);
+            std::vector<uint32_t> found(candidates.begin(), candidates.end());
+
+            // both lists are in depth first order and the subtrees of the
+            // ancestors are nested or disjoint, so one merge pass is enough
+            if (!q.under.empty()) {
+                auto ancestors = lookup(by_name_, q.under);
+                std::vector<uint32_t> open, kept;
+                size_t k = 0;
+                for (uint32_t c : found) {
+                    for (; k < ancestors.size() && ancestors[k] < c; ++k) {
+                        while (!open.empty() && end_[open.back()] <= ancestors[k])
+                            open.pop_back();
+                        open.push_back(ancestors[k]);
+                    }
+                    while (!open.empty() && end_[open.back()] <= c)
+                        open.pop_back();
+                    if (!open.empty())
+                        kept.push_back(c);
+                }
+                found = std::move(kept);
+            }
+
+            if (q.containing) {
+                std::vector<uint32_t> terminals;
+                for (uint32_t t : lookup(by_token_, *q.containing))
+                    if (q.text.empty() || nodes_[t]->tokenstr == q.text)
+                        terminals.push_back(t);
+                std::erase_if(found, [&](uint32_t c) {
+                    auto t = std::lower_bound(terminals.begin(), terminals.end(), c);
+                    return t == terminals.end() || *t >= end_[c];
+                });
+            }
+            return to_nodes(found);
+        }
+    };
+}
@@ -2,8 +2,8 @@
 
 #include "ast_node.h"
 #include "token.h"
-#include "ast_graph.h"
 #include <functional>
+#include <unordered_map>
 #include <variant>
 
 namespace onek {
@@ -14,6 +14,7 @@ namespace onek {
         action_function action_;
         token_id token_id_ = token_id::error;
         std::string_view tokenstr;
+        token_value value_;
         char const *name_ = "unknown";
         unsigned short flags = FLAG_NONE;
         ast_node *parent_ = nullptr;// todo, use indices instead of pointers
@@ -21,14 +22,28 @@ namespace onek {
         ast_node *next_sibbling_ = nullptr;
         ast_node *prev_sibbling_ = nullptr;
         ast_node *last_child_ = nullptr;
-        ushort id = ++uuid;// only needed for debugging
+        ast_node const *shared_ = nullptr;// an identical subtree that stands for this one, see hash_cons.h
+
+        // results of actions, keyed by the representative of identical subtrees
+        struct execution_cache {
+            std::unordered_map<ast_node const *, typename F::V> results;
+            unsigned short flags = FLAG_PURE;// nodes with one of these flags are cached
+        };
+        static inline thread_local execution_cache *active_cache_ = nullptr;// set by ast::execute
 
         bool isTerminal() const noexcept {
             return first_child_ == nullptr;
         }
 
         F::V action() const noexcept {
-            return action_(*this);
+            if (!active_cache_ || !(flags & active_cache_->flags))
+                return action_(*this);
+            auto const *key = shared_ ? shared_ : this;
+            if (auto it = active_cache_->results.find(key); it != active_cache_->results.end())
+                return it->second;
+            auto result = action_(*this);
+            active_cache_->results.emplace(key, result);
+            return result;
         }
 
         void add_child(ast_node *new_child) {
@@ -0,0 +1,139 @@
+#pragma once
+
+#include "ast_node.h"
+#include "token.h"
+#include <algorithm>
+#include <cassert>
+#include <deque>
+#include <functional>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace onek {
+
+    // Elementwise kernels. The operator is dispatched once per block and the
+    // loops are kept trivial, so that the compiler can vectorize them.
+    template<typename T>
+    void apply_binary(char op, std::span<T> acc, std::span<T const> rhs) noexcept {
+        assert(acc.size() <= rhs.size());
+        T *__restrict a = acc.data();
+        T const *__restrict b = rhs.data();
+        size_t const n = acc.size();
+        switch (op) {
+            case '+': for (size_t i = 0; i < n; ++i) a[i] += b[i]; break;
+            case '-': for (size_t i = 0; i < n; ++i) a[i] -= b[i]; break;
+            case '*': for (size_t i = 0; i < n; ++i) a[i] *= b[i]; break;
+            case '/': for (size_t i = 0; i < n; ++i) a[i] /= b[i]; break;
+            default: assert(false);
+        }
+    }
+
+    template<typename T>
+    void apply_unary(char op, std::span<T> acc) noexcept {
+        T *__restrict a = acc.data();
+        size_t const n = acc.size();
+        if (op == '-')
+            for (size_t i = 0; i < n; ++i) a[i] = -a[i];
+    }
+
+    // Evaluates one ast over many rows. The identifiers of the expression are
+    // bound to columns (one value per row) and every node is evaluated for a
+    // block of rows at once, i.e. actions work on spans instead of scalars.
+    // Kernels are registered per production name. Nodes without kernel pass
+    // through the value of their first child, like a typical default_action.
+    // Identifiers must have been interned while parsing, see symbol_table.h
+    template<typename F, typename T>
+    class batch_evaluator {
+        public:
+        using N = ast_node<F>;
+        using kernel = std::function<void(N const &, batch_evaluator &, std::span<T>)>;
+        static constexpr size_t block_size = 1024;
+
+        // temporary buffer for the value of a child node, valid until destruction.
+        // Buffers are handed out and given back in stack order.
+        class scratch {
+            batch_evaluator &ev_;
+            std::span<T> span_;
+
+            public:
+            scratch(batch_evaluator &ev, size_t rows) : ev_(ev) {
+                if (ev.used_ == ev.pool_.size())
+                    ev.pool_.emplace_back(block_size);
+                span_ = {ev.pool_[ev.used_++].data(), rows};
+            }
+            scratch(scratch const &) = delete;
+            ~scratch() { --ev_.used_; }
+            [[nodiscard]] std::span<T> span() const noexcept { return span_; }
+        };
+
+        private:
+        N const *root_;
+        std::vector<std::span<T const>> columns_;// indexed by symbol_id
+        std::unordered_map<std::string_view, kernel> kernels_;
+        std::deque<std::vector<T>> pool_;// a deque, so that buffers in use do not move
+        size_t used_ = 0;
+        size_t block_begin_ = 0;
+
+        public:
+        explicit batch_evaluator(N const *root) : root_(root) {}
+
+        void bind(symbol_id id, std::span<T const> column) {
+            auto i = size_t(id);
+            if (i >= columns_.size())
+                columns_.resize(i + 1);
+            columns_[i] = column;
+        }
+
+        void on(char const *production, kernel k) { kernels_[production] = std::move(k); }
+
+        // evaluates out.size() rows, all bound columns must be at least that long
+        void evaluate(std::span<T> out) {
+            for (block_begin_ = 0; block_begin_ < out.size(); block_begin_ += block_size)
+                evaluate(*root_, out.subspan(block_begin_, std::min(block_size, out.size() - block_begin_)));
+        }
+
+        // evaluates node for the rows of the current block, to be called by kernels
+        void evaluate(N const &node, std::span<T> out) {
+            if (node.isTerminal()) {
+                if (auto const *id = std::get_if<symbol_id>(&node.value_)) {
+                    assert(size_t(*id) < columns_.size() && "identifier not bound to a column");
+                    auto column = columns_[size_t(*id)].subspan(block_begin_, out.size());
+                    std::copy(column.begin(), column.end(), out.begin());
+                } else if (auto const *l = std::get_if<long>(&node.value_))
+                    std::fill(out.begin(), out.end(), T(*l));
+                else if (auto const *d = std::get_if<double>(&node.value_))
+                    std::fill(out.begin(), out.end(), T(*d));
+                else
+                    assert(false && "terminal without value");
+                return;
+            }
+            auto k = kernels_.find(node.name_);
+            if (k != kernels_.end())
+                k->second(node, *this, out);
+            else
+                evaluate(*node.first_child_, out);
+        }
+
+        // kernel for the children operand (operator operand)*, evaluated from left to right
+        static void infix(N const &node, batch_evaluator &ev, std::span<T> out) {
+            N const *left = node.first_child_;
+            ev.evaluate(*left, out);
+            auto tmp = scratch(ev, out.size());
+            for (N const *op = left->next_sibbling_; op && op->next_sibbling_; op = op->next_sibbling_->next_sibbling_) {
+                ev.evaluate(*op->next_sibbling_, tmp.span());
+                apply_binary<T>(op->tokenstr.front(), out, tmp.span());
+            }
+        }
+
+        // kernel for the children operator operand, or operand only
+        static void prefix(N const &node, batch_evaluator &ev, std::span<T> out) {
+            N const *op = node.first_child_;
+            if (!op->next_sibbling_)
+                return ev.evaluate(*op, out);
+            ev.evaluate(*op->next_sibbling_, out);
+            apply_unary<T>(op->tokenstr.front(), out);
+        }
+    };
+}
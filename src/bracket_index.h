@@ -0,0 +1,189 @@
+#pragma once
+
+#include "error_messages.h"
+#include "scan_state.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace onek {
+
+    namespace detail {
+
+        // +k for the opening and -k for the closing bracket of the k-th pair
+        // of brackets, e.g. "()[]", 0 for the other bytes
+        inline std::array<signed char, 256> bracket_kinds(std::string_view brackets) noexcept {
+            assert(brackets.size() % 2 == 0);
+            std::array<signed char, 256> kind{};
+            for (size_t k = 0; k < brackets.size(); k += 2) {
+                kind[(unsigned char)brackets[k]] = static_cast<signed char>(k / 2 + 1);
+                kind[(unsigned char)brackets[k + 1]] = static_cast<signed char>(-(k / 2 + 1));
+            }
+            return kind;
+        }
+    }
+
+    // Stage one of a parse, like the structural index of simdjson: one sweep
+    // over the text pairs every bracket with its partner. Attached to a scan
+    // state, see scan_state::brackets_, the parse rejects text with unbalanced
+    // brackets before the first production is tried, and matches the inside of
+    // a bracket pair as if the text ended at its closing bracket, so that an
+    // alternative that fails inside does not scan beyond it.
+    // Brackets are counted wherever they are, grammars that allow them in
+    // strings or comments can not use the index. The text must outlive it.
+    class bracket_index {
+        public:
+        struct pair {
+            uint32_t open;  // offsets of the brackets
+            uint32_t close;
+            uint32_t parent;// the enclosing pair, no_parent at the top level
+        };
+        static constexpr uint32_t no_parent = UINT32_MAX;
+        static constexpr size_t npos = std::string_view::npos;
+
+        private:
+        std::string_view text_;
+        std::vector<pair> pairs_;       // ordered by open
+        std::vector<uint32_t> by_close_;// numbers of the pairs ordered by close
+        size_t error_ = npos;
+
+        pair const *find_open(size_t offset) const noexcept {
+            auto it = std::lower_bound(pairs_.begin(), pairs_.end(), offset, [](pair const &p, size_t o) { return p.open < o; });
+            return it != pairs_.end() && it->open == offset ? &*it : nullptr;
+        }
+        pair const *find_close(size_t offset) const noexcept {
+            auto it = std::lower_bound(by_close_.begin(), by_close_.end(), offset, [this](uint32_t i, size_t o) { return pairs_[i].close < o; });
+            return it != by_close_.end() && pairs_[*it].close == offset ? &pairs_[*it] : nullptr;
+        }
+
+        public:
+        // brackets lists the pairs, e.g. "()[]" for () and [], see declared_brackets in grammar_walk.h
+        explicit bracket_index(std::string_view text, std::string_view brackets = "()[]{}") : text_(text) {
+            assert(text.size() < no_parent);
+            auto const kind = detail::bracket_kinds(brackets);
+
+            std::vector<uint32_t> open;// pairs that are not closed yet
+            auto visit = [&](size_t i) {
+                signed char const k = kind[(unsigned char)text[i]];
+                if (k > 0) {
+                    open.push_back(uint32_t(pairs_.size()));
+                    pairs_.push_back({uint32_t(i), 0, open.size() > 1 ? open[open.size() - 2] : no_parent});
+                } else if (k < 0) {
+                    if (open.empty() || kind[(unsigned char)text[pairs_[open.back()].open]] != -k) {
+                        error_ = i;
+                        return false;
+                    }
+                    pairs_[open.back()].close = uint32_t(i);
+                    by_close_.push_back(open.back());
+                    open.pop_back();
+                }
+                return true;
+            };
+
+            char const *p = text.data();
+            size_t const n = text.size();
+            size_t i = 0;
+#if defined(__SSE2__)
+            // up to 8 pairs, more are left to the loop below
+            __m128i special[16];
+            size_t const count = std::min<size_t>(brackets.size(), 16);
+            for (size_t k = 0; k < count; ++k)
+                special[k] = _mm_set1_epi8(brackets[k]);
+            for (; brackets.size() <= 16 && i + 16 <= n; i += 16) {
+                __m128i bytes = _mm_loadu_si128(reinterpret_cast<__m128i const *>(p + i));
+                __m128i hits = _mm_setzero_si128();
+                for (size_t k = 0; k < count; ++k)
+                    hits = _mm_or_si128(hits, _mm_cmpeq_epi8(bytes, special[k]));
+                for (auto mask = unsigned(_mm_movemask_epi8(hits)); mask; mask &= mask - 1)
+                    if (!visit(i + std::countr_zero(mask)))
+                        return;
+            }
+#endif
+            for (; i < n; ++i)
+                if (!visit(i))
+                    return;
+            if (!open.empty())
+                error_ = pairs_[open.back()].open;
+        }
+
+        [[nodiscard]] std::string_view text() const noexcept { return text_; }
+        [[nodiscard]] bool balanced() const noexcept { return error_ == npos; }
+        // offset of the first bracket without a partner, npos if the text is balanced
+        [[nodiscard]] size_t error() const noexcept { return error_; }
+        [[nodiscard]] std::span<pair const> pairs() const noexcept { return pairs_; }
+
+        // offset of the other bracket of the pair of the bracket at offset, npos if there is none
+        [[nodiscard]] size_t partner(size_t offset) const noexcept {
+            if (auto const *p = find_open(offset))
+                return p->close;
+            if (auto const *p = find_close(offset))
+                return p->open;
+            return npos;
+        }
+
+        // where the text ends for the parse once the bracket at close is
+        // matched: at the closing bracket of the enclosing pair, or at the end
+        [[nodiscard]] size_t outer_end(size_t close) const noexcept {
+            auto const *p = find_close(close);
+            assert(p);
+            return p->parent == no_parent ? text_.size() : pairs_[p->parent].close;
+        }
+    };
+
+    namespace detail {
+
+        // to be called by the entry points of a parse
+        inline bool begin_parse(scan_state &scn) noexcept {
+            scn.status_ = parse_status::ok;
+            auto const *b = scn.brackets_;
+            if (!b || scn.tokens_)
+                return true;
+            assert(b->text().data() <= scn.p_ && scn.scanner_end_ == b->text().data() + b->text().size());
+            if (b->balanced())
+                return true;
+            scn.status_ = parse_status::unbalanced;
+            log::unbalanced(b->text().data() + b->error(), scn.scanner_end_);
+            return false;
+        }
+
+        // Matches an opening or closing bracket with match() while the scan
+        // state has a bracket index. After an opening bracket the text ends
+        // at its partner. The closing bracket is beyond that end, so it is
+        // matched with the end of the enclosing region.
+        template<typename M>
+        std::string_view match_bracket(scan_state &scn, bool open, M const &match) noexcept {
+            auto const *b = scn.brackets_;
+            char const *const text = b->text().data();
+            if (open) {
+                std::string_view s = match();
+                if (s.size() == 1) {
+                    size_t const offset = size_t(s.data() - text);
+                    if (size_t close = b->partner(offset); close != bracket_index::npos && close > offset)
+                        scn.scanner_end_ = text + close;
+                }
+                return s;
+            }
+            char const *const end = scn.scanner_end_;
+            char const *q = scn.p_;
+            while (q < end && is_space(*q))
+                ++q;
+            if (q != end || end == text + b->text().size() || b->partner(size_t(end - text)) == bracket_index::npos)
+                return match();
+            scn.scanner_end_ = text + b->outer_end(size_t(end - text));
+            std::string_view s = match();
+            if (s.empty())
+                scn.scanner_end_ = end;
+            return s;
+        }
+    }
+}
@@ -13,13 +13,14 @@
 namespace onek {
 
     class log {
-        static inline auto cb = boost::circular_buffer<std::stringstream>(30);
-        static inline auto ss = std::stringstream{};
+        // one log per thread, parsers may run concurrently, see parallel_parse.h
+        static inline thread_local auto cb = boost::circular_buffer<std::stringstream>(30);
+        static inline thread_local auto ss = std::stringstream{};
 
         class indentation {
-            static inline int indentation_ = 0;
-            static inline std::stack<std::pair<char const *, long>> text_;
-            static inline long counter = 0;
+            static inline thread_local int indentation_ = 0;
+            static inline thread_local std::stack<std::pair<char const *, long>> text_;
+            static inline thread_local long counter = 0;
 
             public:
             static inline int padding() { return indentation_; }
@@ -155,6 +156,59 @@ namespace onek {
                 ss << *x;
             ss << "'\n";
         }
+        static void cut_failure(char const *cut_point, size_t line_number, const char *line_begin, const char *scanner_end) noexcept {
+            ss
+                << "\nin line " << line_number
+                << " error: no match after cut, alternatives are not tried anymore"
+                << "\n    text: '";
+            for (auto x = line_begin; *x != '\n' && x != scanner_end; ++x)
+                ss << *x;
+            ss << "'\n    cut:  '";
+            int length = std::min(40L, (scanner_end - cut_point));
+            std::copy(cut_point, cut_point + length, std::ostreambuf_iterator(ss));
+            ss << "...'\n";
+        }
+
+        static void limit_exceeded(char const *limit, size_t line_number, const char *line_begin, const char *scanner_end) noexcept {
+            ss
+                << "\nin line " << line_number
+                << " error: resource limit exceeded: " << limit
+                << "\n    text: '";
+            for (auto x = line_begin; *x != '\n' && x != scanner_end; ++x)
+                ss << *x;
+            ss << "'\n";
+        }
+
+        static void budget_exhausted(char const *reason, char const *production, size_t line_number, const char *line_begin, const char *scanner_end) noexcept {
+            ss
+                << "\nin line " << line_number
+                << " error: parse stopped (" << reason << ") in production '" << production << '\''
+                << "\n    text: '";
+            for (auto x = line_begin; *x != '\n' && x != scanner_end; ++x)
+                ss << *x;
+            ss << "'\n";
+        }
+
+        static void unit_failure(size_t unit, std::string_view text) noexcept {
+            ss << "\nerror: unit " << unit << " did not parse: '" << text.substr(0, 40) << "...'\n";
+            cb.push_back(std::move(ss));
+            ss.clear();
+        }
+
+        static void lexer_error(char const *position, char const *scanner_end) noexcept {
+            ss << "\nlexer error: no token matches at '";
+            int length = std::min(40L, (scanner_end - position));
+            std::copy(position, position + length, std::ostreambuf_iterator(ss));
+            ss << "...'\n";
+        }
+
+        static void unbalanced(char const *bracket, char const *scanner_end) noexcept {
+            ss << "\nerror: bracket without partner at '";
+            int length = std::min(40L, (scanner_end - bracket));
+            std::copy(bracket, bracket + length, std::ostreambuf_iterator(ss));
+            ss << "...'\n";
+        }
+
         template<typename AstNodeValue>
         static void log_result(AstNodeValue const &value) noexcept {
             std::visit([](auto &&result) { ss << "\n\nresult: " << result << std::endl; }, value);
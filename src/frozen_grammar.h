@@ -0,0 +1,232 @@
+#pragma once
+
+#include "grammar_walk.h"
+#include "parser.h"
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace onek {
+
+    enum class frozen_kind : unsigned char {
+        sequence,
+        alternative,
+        cut,
+        list,
+        trailing_list,
+        literals,// terminal matching one of a set of strings
+        delegate // parsed by the original parser, e.g. terminals with regex or scanner
+    };
+
+    // one production of a frozen grammar
+    struct frozen_node {
+        frozen_kind kind = frozen_kind::delegate;
+        token_id token = token_id::composed;
+        unsigned short flags = FLAG_NONE;
+        uint32_t first = 0;// index of the first child in children_ or of the first literal in literals_
+        uint32_t count = 0;// number of children or literals
+        uint32_t min_repeat = 1;
+        uint32_t max_repeat = 1;
+        uint32_t action = 0;// index into actions_ for composed nodes, else into origins_
+        char const *name = "unknown";
+        char const *delim = nullptr;
+    };
+
+    template<typename F>
+    class frozen_grammar;
+    struct optimize_stats;
+    template<typename F>
+    optimize_stats optimize(frozen_grammar<F> &grammar);
+
+    // A wired grammar laid out as one contiguous array of compact records.
+    // Children are referred to by index and placeholders are resolved to the
+    // children of the production they stand for, so the parse loop neither
+    // chases parser pointers nor calls the std::function of the combinators.
+    // Records are in depth first order from the root, i.e. parents come before
+    // their children except for the back references of recursive productions.
+    // A frozen grammar is a value and cheap to copy. Terminals that are not
+    // matched by literals still refer to their original parser, hence the
+    // arena of the original grammar must outlive it.
+    template<typename F>
+    class frozen_grammar {
+        using A = ast<F>;
+        using B = parser_base<F>;
+        using C = composed_parser<F>;
+        using T = terminal_parser<F>;
+        using N = ast_node<F>;
+
+        std::vector<frozen_node> nodes_;
+        std::vector<uint32_t> children_;
+        std::vector<std::string_view> literals_;
+        std::vector<typename N::action_function> actions_;
+        std::vector<B const *> origins_;
+
+        friend optimize_stats optimize<F>(frozen_grammar &grammar);
+
+        static uint32_t clamp(size_t n) { return uint32_t(std::min<size_t>(n, std::numeric_limits<uint32_t>::max())); }
+
+        public:
+        using configuration = F;
+
+        explicit frozen_grammar(B *root) {
+            assert(root && root->isRewired && "call wire_placeholders before freezing the grammar");
+            std::unordered_map<B const *, uint32_t> index;
+            std::vector<B *> order;
+            for_each_parser(root, [&](B *b) {
+                index[b] = uint32_t(order.size());
+                order.push_back(b);
+            });
+
+            nodes_.reserve(order.size());
+            for (B *b : order) {
+                frozen_node n;
+                if (!b->isComposed()) {
+                    auto *t = static_cast<T *>(b);
+                    n.token = t->token_id_;
+                    n.flags = t->flags_;
+                    n.name = t->name_;
+                    n.min_repeat = clamp(t->min_repeat_);
+                    n.max_repeat = clamp(t->max_repeat_);
+                    n.delim = t->delim_;
+                    n.action = uint32_t(origins_.size());
+                    origins_.push_back(t);
+                    if (t->literal_match_) {
+                        n.kind = frozen_kind::literals;
+                        n.first = uint32_t(literals_.size());
+                        for (char const *f : t->filters_) {
+                            if (!f || !*f) break;
+                            literals_.emplace_back(f);
+                        }
+                        n.count = uint32_t(literals_.size()) - n.first;
+                    }
+                } else {
+                    auto *c = static_cast<C *>(b);
+                    n.flags = c->flags_;
+                    n.name = c->name_;
+                    n.min_repeat = clamp(c->min_repeat_);
+                    n.max_repeat = clamp(c->max_repeat_);
+                    n.delim = c->delim_;
+                    switch (c->kind_) {
+                        case combinator::sequence: n.kind = frozen_kind::sequence; break;
+                        case combinator::alternative: n.kind = frozen_kind::alternative; break;
+                        case combinator::cut: n.kind = frozen_kind::cut; break;
+                        case combinator::list: n.kind = frozen_kind::list; break;
+                        case combinator::trailing_list: n.kind = frozen_kind::trailing_list; break;
+                        case combinator::custom: n.kind = frozen_kind::delegate; break;
+                    }
+                    if (n.kind == frozen_kind::delegate) {
+                        n.action = uint32_t(origins_.size());
+                        origins_.push_back(c);
+                    } else {
+                        n.action = uint32_t(actions_.size());
+                        actions_.push_back(c->action_);
+                        n.first = uint32_t(children_.size());
+                        for (B *child : {c->left_, c->right_})
+                            if (child)
+                                children_.push_back(index.at(child));
+                        n.count = uint32_t(children_.size()) - n.first;
+                    }
+                }
+                nodes_.push_back(n);
+            }
+        }
+
+        [[nodiscard]] std::span<frozen_node const> nodes() const noexcept { return nodes_; }
+        [[nodiscard]] std::span<uint32_t const> children(frozen_node const &n) const noexcept { return std::span(children_).subspan(n.first, n.count); }
+        [[nodiscard]] std::span<std::string_view const> literals(frozen_node const &n) const noexcept { return std::span(literals_).subspan(n.first, n.count); }
+        // the parser a terminal or a delegate record was frozen from
+        [[nodiscard]] B const *origin(frozen_node const &n) const noexcept {
+            assert(n.kind == frozen_kind::literals || n.kind == frozen_kind::delegate);
+            return origins_[n.action];
+        }
+
+        std::optional<A> parse(scan_state &scn, bool reportErrors) const noexcept {
+            if (!detail::begin_parse(scn))
+                return std::nullopt;
+            A a(scn.ast_memory_);
+            if (parse(0, a, scn, nullptr, reportErrors))
+                return a;
+            else
+                return std::nullopt;
+        }
+
+        // see composed_parser::recognize
+        bool recognize(scan_state &scn, bool reportErrors) const noexcept {
+            if (!detail::begin_parse(scn))
+                return false;
+            A a(nullptr, parse_mode::recognize);
+            return parse(0, a, scn, nullptr, reportErrors);
+        }
+
+        // see composed_parser::parse with parse_events
+        bool parse(scan_state &scn, parse_events const &events, bool reportErrors) const {
+            if (!detail::begin_parse(scn))
+                return false;
+            A a(nullptr, parse_mode::events, &events);
+            return parse(0, a, scn, nullptr, reportErrors);
+        }
+
+        bool parse(uint32_t index, A &a, scan_state &scn, N *ast_parent, bool reportErrors) const noexcept {
+            frozen_node const &n = nodes_[index];
+            switch (n.kind) {
+                case frozen_kind::literals: {
+                    auto const *t = static_cast<T const *>(origins_[n.action]);
+                    auto l = literals(n);
+                    return t->parse_with(a, scn, ast_parent, reportErrors, [&scn, l]() { return detail::match_literals(scn, l); }, l);
+                }
+                case frozen_kind::delegate:
+                    return origins_[n.action]->parse(a, scn, ast_parent, reportErrors);
+                default:
+                    return detail::parse_composed(a, scn, ast_parent, reportErrors, n.name, n.flags, actions_[n.action], n.min_repeat, n.max_repeat, n.delim,
+                                                  [&](N *node, bool expectFlag) { return match_once(n, a, scn, node, expectFlag); });
+            }
+        }
+
+        private:
+        // the equivalent of the combinators in parser_combinators.h for n children
+        bool match_once(frozen_node const &n, A &a, scan_state &scn, N *node, bool expectFlag) const noexcept {
+            auto c = children(n);
+            switch (n.kind) {
+                case frozen_kind::sequence:
+                    for (uint32_t child : c)
+                        if (!parse(child, a, scn, node, expectFlag))
+                            return false;
+                    return true;
+                case frozen_kind::alternative:
+                    for (size_t k = 0; k + 1 < c.size(); ++k) {
+                        typename A::choice_point const choice(a);
+                        if (parse(c[k], a, scn, node, false))
+                            return true;
+                        if (scn.is_aborted())
+                            return false;
+                    }
+                    return parse(c.back(), a, scn, node, expectFlag);
+                case frozen_kind::cut:
+                    if (!parse(c[0], a, scn, node, expectFlag))
+                        return false;
+                    scn.cut_point_ = scn.p_;
+                    for (uint32_t child : c.subspan(1)) {
+                        if (!parse(child, a, scn, node, true)) {
+                            detail::cut_failure(scn);
+                            return false;
+                        }
+                    }
+                    return true;
+                case frozen_kind::list:
+                case frozen_kind::trailing_list:
+                    return detail::parse_list(
+                            a, scn, node, expectFlag, n.kind == frozen_kind::trailing_list,
+                            [&](bool reportErrors) { return parse(c[0], a, scn, node, reportErrors); },
+                            [&](bool reportErrors) { return parse(c[1], a, scn, node, reportErrors); });
+                default:
+                    assert(false);
+                    return false;
+            }
+        }
+    };
+}
@@ -0,0 +1,208 @@
+#pragma once
+
+#include "frozen_grammar.h"
+#include "parse_events.h"
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+namespace onek {
+
+    struct optimize_stats {
+        size_t nodes_before = 0;
+        size_t nodes_after = 0;
+        size_t flattened = 0;      // children merged into a parent of the same kind
+        size_t merged_literals = 0;// literal terminals merged into the one before them
+        size_t factored = 0;       // alternatives that start like the one before them
+        size_t inlined = 0;        // references to unnamed productions of one child
+    };
+
+    inline std::ostream &operator<<(std::ostream &os, optimize_stats const &s) {
+        return os << "nodes: " << s.nodes_before << " -> " << s.nodes_after << ", flattened: " << s.flattened
+                  << ", merged literals: " << s.merged_literals << ", factored: " << s.factored << ", inlined: " << s.inlined;
+    }
+
+    // Rewrites a frozen grammar into a smaller one that builds the same ast:
+    //  - sequences in sequences and alternatives in alternatives become one n-ary node
+    //  - adjacent literal alternatives of the same token become one literal set
+    //  - unnamed productions with a single child are replaced by the child
+    //  - adjacent alternatives that start with the same element share it,
+    //    x >> y | x >> z becomes x >> (y | z)
+    // Only productions without name, action and repetition are removed, since
+    // they neither create ast nodes nor report anything. Unreachable records
+    // are dropped.
+    template<typename F>
+    optimize_stats optimize(frozen_grammar<F> &grammar) {
+        optimize_stats stats;
+        stats.nodes_before = grammar.nodes_.size();
+
+        // unpacked, so that children and literals can be changed in place
+        std::vector<frozen_node> nodes = grammar.nodes_;
+        std::vector<std::vector<uint32_t>> kids(nodes.size());
+        std::vector<std::vector<std::string_view>> literals(nodes.size());
+        for (uint32_t i = 0; i < nodes.size(); ++i) {
+            auto const &n = nodes[i];
+            if (n.kind == frozen_kind::literals)
+                literals[i].assign(grammar.literals_.begin() + n.first, grammar.literals_.begin() + n.first + n.count);
+            else if (n.kind != frozen_kind::delegate)
+                kids[i].assign(grammar.children_.begin() + n.first, grammar.children_.begin() + n.first + n.count);
+        }
+
+        auto const default_action = uint32_t(grammar.actions_.size());
+        grammar.actions_.push_back(F::default_action);
+        auto add = [&](frozen_node n, std::vector<uint32_t> k, std::vector<std::string_view> l) {
+            nodes.push_back(n);
+            kids.push_back(std::move(k));
+            literals.push_back(std::move(l));
+            return uint32_t(nodes.size() - 1);
+        };
+        auto wrapper = [&](frozen_kind kind, std::vector<uint32_t> k) {
+            frozen_node n;
+            n.kind = kind;
+            n.action = default_action;
+            return add(n, std::move(k), {});
+        };
+
+        auto is_wrapper = [&](uint32_t i) {
+            auto const &n = nodes[i];
+            return (n.kind == frozen_kind::sequence || n.kind == frozen_kind::alternative) && !is_named_production(n.name)
+                   && !(n.flags & FLAG_ACTION_PARENT) && n.min_repeat == 1 && n.max_repeat == 1 && !n.delim;
+        };
+        auto is_literal = [&](uint32_t i) {
+            auto const &n = nodes[i];
+            return n.kind == frozen_kind::literals && n.min_repeat == 1 && n.max_repeat == 1 && !n.delim;
+        };
+        auto same = [&](uint32_t x, uint32_t y) {
+            return x == y
+                   || (is_literal(x) && is_literal(y) && nodes[x].token == nodes[y].token && nodes[x].flags == nodes[y].flags
+                       && literals[x] == literals[y]);
+        };
+
+        // the records reachable from the root in depth first order
+        auto reachable = [&]() {
+            std::vector<bool> seen(nodes.size());
+            std::vector<uint32_t> order;
+            std::vector<uint32_t> todo{0};
+            while (!todo.empty()) {
+                uint32_t i = todo.back();
+                todo.pop_back();
+                if (seen[i])
+                    continue;
+                seen[i] = true;
+                order.push_back(i);
+                for (auto k = kids[i].rbegin(); k != kids[i].rend(); ++k)
+                    todo.push_back(*k);
+            }
+            return order;
+        };
+
+        // children before their parents, so that a parent sees optimized children
+        for (bool changed = true; changed;) {
+            changed = false;
+            auto const order = reachable();
+            for (auto it = order.rbegin(); it != order.rend(); ++it) {
+                uint32_t const i = *it;
+                auto const kind = nodes[i].kind;
+                if (kind == frozen_kind::literals || kind == frozen_kind::delegate)
+                    continue;
+
+                for (auto &k : kids[i]) {
+                    while (is_wrapper(k) && kids[k].size() == 1) {
+                        k = kids[k][0];
+                        ++stats.inlined;
+                        changed = true;
+                    }
+                }
+                if (kind != frozen_kind::sequence && kind != frozen_kind::alternative)
+                    continue;
+
+                std::vector<uint32_t> flat;
+                for (uint32_t k : kids[i]) {
+                    if (k != i && nodes[k].kind == kind && is_wrapper(k)) {
+                        flat.insert(flat.end(), kids[k].begin(), kids[k].end());
+                        ++stats.flattened;
+                        changed = true;
+                    } else
+                        flat.push_back(k);
+                }
+                kids[i] = std::move(flat);
+                if (kind != frozen_kind::alternative)
+                    continue;
+
+                // the first literal that fits wins, so the order of the sets is kept
+                // add grows kids, so the children are iterated on a copy
+                std::vector<uint32_t> merged;
+                for (uint32_t k : std::vector<uint32_t>(kids[i])) {
+                    uint32_t m = merged.empty() ? k : merged.back();
+                    if (m != k && is_literal(m) && is_literal(k) && nodes[m].token == nodes[k].token && nodes[m].flags == nodes[k].flags) {
+                        auto l = literals[m];
+                        l.insert(l.end(), literals[k].begin(), literals[k].end());
+                        merged.back() = add(nodes[m], {}, std::move(l));
+                        ++stats.merged_literals;
+                        changed = true;
+                    } else
+                        merged.push_back(k);
+                }
+                kids[i] = std::move(merged);
+
+                // a parse is deterministic, so matching the common first element
+                // once gives the same result as trying it in each alternative
+                std::vector<uint32_t> factored;
+                auto starts_like = [&](uint32_t k, uint32_t first) {
+                    return is_wrapper(k) && nodes[k].kind == frozen_kind::sequence && kids[k].size() > 1 && same(kids[k][0], first);
+                };
+                for (size_t p = 0; p < kids[i].size();) {
+                    uint32_t const k = kids[i][p];
+                    size_t q = p + 1;
+                    if (is_wrapper(k) && nodes[k].kind == frozen_kind::sequence && kids[k].size() > 1)
+                        while (q < kids[i].size() && starts_like(kids[i][q], kids[k][0]))
+                            ++q;
+                    if (q - p == 1) {
+                        factored.push_back(k);
+                        ++p;
+                        continue;
+                    }
+                    std::vector<uint32_t> rests;
+                    for (size_t r = p; r < q; ++r) {
+                        auto const &rk = kids[kids[i][r]];
+                        rests.push_back(rk.size() == 2 ? rk[1] : wrapper(frozen_kind::sequence, {rk.begin() + 1, rk.end()}));
+                    }
+                    uint32_t const first = kids[k][0];
+                    uint32_t const alternative = wrapper(frozen_kind::alternative, std::move(rests));
+                    factored.push_back(wrapper(frozen_kind::sequence, {first, alternative}));
+                    stats.factored += q - p - 1;
+                    changed = true;
+                    p = q;
+                }
+                kids[i] = std::move(factored);
+            }
+        }
+
+        // lay out what is still reachable
+        auto const order = reachable();
+        std::vector<uint32_t> index(nodes.size());
+        for (uint32_t i = 0; i < order.size(); ++i)
+            index[order[i]] = i;
+
+        grammar.nodes_.clear();
+        grammar.children_.clear();
+        grammar.literals_.clear();
+        for (uint32_t i : order) {
+            frozen_node n = nodes[i];
+            if (n.kind == frozen_kind::literals) {
+                n.first = uint32_t(grammar.literals_.size());
+                grammar.literals_.insert(grammar.literals_.end(), literals[i].begin(), literals[i].end());
+                n.count = uint32_t(literals[i].size());
+            } else if (n.kind != frozen_kind::delegate) {
+                n.first = uint32_t(grammar.children_.size());
+                for (uint32_t k : kids[i])
+                    grammar.children_.push_back(index[k]);
+                n.count = uint32_t(kids[i].size());
+            }
+            grammar.nodes_.push_back(n);
+        }
+        stats.nodes_after = grammar.nodes_.size();
+        return stats;
+    }
+}
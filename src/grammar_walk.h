@@ -0,0 +1,53 @@
+#pragma once
+
+#include "parser.h"
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace onek {
+
+    // Calls visit once for every parser reachable from root, parents before
+    // children and left before right. The parser graph is not a tree:
+    // wired placeholders share the children of the production they refer to.
+    template<typename F, typename V>
+    void for_each_parser(parser_base<F> *root, V &&visit) {
+        std::unordered_set<parser_base<F> *> seen;
+        std::vector<parser_base<F> *> todo{root};
+        while (!todo.empty()) {
+            auto *b = todo.back();
+            todo.pop_back();
+            if (!b || !seen.insert(b).second)
+                continue;
+            visit(b);
+            if (b->isComposed()) {
+                auto *c = static_cast<composed_parser<F> *>(b);
+                todo.push_back(c->right_);
+                todo.push_back(c->left_);
+            }
+        }
+    }
+
+    // the bracket pairs of a grammar for bracket_index, e.g. "()[]": the known
+    // pairs whose brackets are literals of open and close terminals
+    template<typename F>
+    std::string declared_brackets(parser_base<F> *root) {
+        std::string opens, closes;
+        for_each_parser(root, [&](parser_base<F> *b) {
+            if (b->isComposed())
+                return;
+            auto const *t = static_cast<terminal_parser<F> *>(b);
+            if (!t->literal_match_ || (t->token_id_ != token_id::open && t->token_id_ != token_id::close))
+                return;
+            for (char const *l : t->filters_)
+                if (detail::literal_view(l).size() == 1)
+                    (t->token_id_ == token_id::open ? opens : closes) += *l;
+        });
+        std::string brackets;
+        for (std::string_view pair : {"()", "[]", "{}", "<>"})
+            if (opens.find(pair[0]) != std::string::npos && closes.find(pair[1]) != std::string::npos)
+                brackets += pair;
+        return brackets;
+    }
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "ast.h"
+#include "ast_node.h"
+#include <cstring>
+#include <functional>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace onek {
+
+    struct hash_cons_stats {
+        size_t nodes = 0;// nodes of the tree
+        size_t unique = 0;// distinct subtrees
+    };
+
+    // Structural hashing: every subtree gets a hash of its production, token
+    // and the hashes of its children, and each subtree that is identical to
+    // one seen before gets ast_node::shared_ pointing to that one. The tree
+    // itself is not changed. Afterwards ast::execute evaluates the actions of
+    // productions marked pure only once per distinct subtree.
+    template<typename F>
+    hash_cons_stats hash_cons(ast<F> &a) {
+        using N = ast_node<F>;
+        auto representative = [](N const *n) { return n->shared_ ? n->shared_ : n; };
+        auto combine = [](size_t seed, size_t h) { return seed ^ (h + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2)); };
+
+        auto identical = [&](N const *x, N const *y) {
+            if (x->token_id_ != y->token_id_ || x->flags != y->flags || strcmp(x->name_, y->name_) || x->value_ != y->value_)
+                return false;
+            if (x->isTerminal() && x->tokenstr != y->tokenstr)
+                return false;
+            N const *cx = x->first_child_;
+            N const *cy = y->first_child_;
+            for (; cx && cy; cx = cx->next_sibbling_, cy = cy->next_sibbling_)
+                if (representative(cx) != representative(cy))
+                    return false;
+            return !cx && !cy;
+        };
+
+        hash_cons_stats stats;
+        std::unordered_map<N const *, size_t> hashes;
+        std::unordered_multimap<size_t, N const *> seen;
+
+        // post order, children before their parent
+        std::vector<std::pair<N *, bool>> todo{{a.get_root_node(), false}};
+        while (!todo.empty()) {
+            auto [n, children_done] = todo.back();
+            todo.pop_back();
+            if (!children_done) {
+                todo.emplace_back(n, true);
+                for (N *c = n->last_child_; c; c = c->prev_sibbling_)
+                    todo.emplace_back(c, false);
+                continue;
+            }
+
+            size_t h = combine(std::hash<std::string_view>{}(n->name_), size_t(n->token_id_));
+            if (n->isTerminal())
+                h = combine(h, std::hash<std::string_view>{}(n->tokenstr));
+            for (N const *c = n->first_child_; c; c = c->next_sibbling_)
+                h = combine(h, hashes[representative(c)]);
+            hashes[n] = h;
+
+            ++stats.nodes;
+            n->shared_ = nullptr;
+            auto [first, last] = seen.equal_range(h);
+            for (; first != last; ++first) {
+                if (identical(n, first->second)) {
+                    n->shared_ = first->second;
+                    break;
+                }
+            }
+            if (!n->shared_) {
+                seen.emplace(h, n);
+                ++stats.unique;
+            }
+        }
+        a.hash_consed_ = true;
+        return stats;
+    }
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "ast_node.h"
+#include "token.h"
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace onek {
+
+    // Evaluates an ast again and again while the values of its identifiers
+    // change. The result of every action node is kept. After changed(id) only
+    // the nodes on the paths from the identifier's terminals to the root are
+    // computed again, all other subtrees return their kept result.
+    // Actions must only depend on their subtree and on identifiers, and
+    // identifiers must have been interned while parsing, see symbol_table.h.
+    // The evaluator refers to the nodes, so the ast must outlive it.
+    template<typename F>
+    class incremental_evaluator {
+        using N = ast_node<F>;
+        N const *root_;
+        typename N::execution_cache cache_{{}, FLAG_ACTION_PARENT | FLAG_PURE};
+        std::unordered_map<symbol_id, std::vector<N const *>> readers_;// the terminals of an identifier
+        size_t recomputed_ = 0;
+
+        public:
+        explicit incremental_evaluator(N const *root) : root_(root) {
+            std::vector<N const *> todo{root};
+            while (!todo.empty()) {
+                N const *n = todo.back();
+                todo.pop_back();
+                if (auto const *id = std::get_if<symbol_id>(&n->value_))
+                    readers_[*id].push_back(n);
+                for (N const *c = n->first_child_; c; c = c->next_sibbling_)
+                    todo.push_back(c);
+            }
+        }
+
+        // the value of the root, computing only what changed since the last call
+        F::V evaluate() noexcept {
+            size_t const kept = cache_.results.size();
+            auto *outer = std::exchange(N::active_cache_, &cache_);
+            auto result = root_->action();
+            N::active_cache_ = outer;
+            recomputed_ = cache_.results.size() - kept;
+            return result;
+        }
+
+        // to be called after the value of identifier id changed
+        void changed(symbol_id id) {
+            auto it = readers_.find(id);
+            if (it == readers_.end())
+                return;
+            // the paths of several terminals join, each node is visited once
+            std::unordered_set<N const *> dirty;
+            for (N const *n : it->second) {
+                for (; n && dirty.insert(n).second; n = n->parent_)
+                    cache_.results.erase(n->shared_ ? n->shared_ : n);
+            }
+        }
+
+        // number of actions computed by the last evaluate
+        [[nodiscard]] size_t recomputed() const noexcept { return recomputed_; }
+        [[nodiscard]] bool reads(symbol_id id) const noexcept { return readers_.contains(id); }
+    };
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include "error_messages.h"
+#include "grammar_walk.h"
+#include "parser.h"
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace onek {
+
+    // Optional pre-pass that turns a text into a token_array once, so that
+    // backtracking resets an index instead of scanning the text again.
+    // All literals and delimiters of the grammar are compiled into one trie
+    // (a DFA over bytes), scanner and regex terminals are run at every
+    // position and the longest match wins, literals win ties (keywords).
+    // Terminals with a custom match function are not lexed, they are still
+    // called while parsing, e.g. the_end that asks scan_state::is_end().
+    // Only suitable for grammars whose tokens do not depend on the parse
+    // context: with signed numbers "1 -2" lexes as two numbers.
+    template<typename F>
+    class lexer {
+        using B = parser_base<F>;
+        using C = composed_parser<F>;
+        using T = terminal_parser<F>;
+
+        // transitions of the literal trie. State 0 is the start state and
+        // never a target, hence 0 also means "no transition"
+        std::vector<std::array<uint32_t, 256>> next_;
+        std::vector<std::optional<token_id>> accept_;
+        std::vector<T const *> scanners_;
+
+        void add_literal(std::string_view literal, token_id id) {
+            uint32_t state = 0;
+            for (unsigned char c : literal) {
+                if (!next_[state][c]) {
+                    next_[state][c] = uint32_t(next_.size());
+                    next_.emplace_back();
+                    accept_.emplace_back();
+                }
+                state = next_[state][c];
+            }
+            if (!accept_[state])// the first terminal of a literal determines its token id
+                accept_[state] = id;
+        }
+
+        public:
+        explicit lexer(B *root) : next_(1), accept_(1) {
+            for_each_parser(root, [this](B *b) {
+                char const *delim = nullptr;
+                if (b->isComposed())
+                    delim = static_cast<C *>(b)->delim_;
+                else {
+                    auto const *t = static_cast<T const *>(b);
+                    delim = t->delim_;
+                    if (t->literal_match_) {
+                        for (char const *f : t->filters_) {
+                            if (!f || !*f) break;
+                            add_literal(f, t->token_id_);
+                        }
+                    } else if (t->lexable_)
+                        scanners_.push_back(t);
+                }
+                if (delim && *delim)
+                    add_literal(delim, token_id::delimiter);
+            });
+            assert(scanners_.size() <= 64 && "a lexeme records its scanners in 64 bits");
+        }
+
+        // lexes [scn.p_, scn.scanner_end_). scn must be the scan state the terminals of
+        // the grammar were created with, it is left unchanged.
+        std::optional<token_array> tokenize(scan_state &scn) const {
+            assert(!scn.tokens_ && "tokenize a scan state that is not in token mode");
+            char const *const begin = scn.p_;
+            char const *const end = scn.scanner_end_;
+            // lexemes store 32 bit offsets, longer texts are not lexed
+            if (size_t(end - begin) > std::numeric_limits<uint32_t>::max())
+                return std::nullopt;
+            auto tokens = token_array{std::string_view(begin, end), {}, {scanners_.begin(), scanners_.end()}};
+
+            for (char const *p = begin;;) {
+                while (p < end && is_space(*p))
+                    ++p;
+                if (p == end || *p == 0)
+                    break;
+
+                size_t best = 0;
+                token_id best_id = token_id::error;
+                token_value best_value;
+                uint64_t best_scanners = 0;
+
+                uint32_t state = 0;
+                for (char const *q = p; q < end && (state = next_[state][static_cast<unsigned char>(*q)]); ++q) {
+                    if (accept_[state]) {
+                        best = q + 1 - p;
+                        best_id = *accept_[state];
+                    }
+                }
+
+                for (size_t k = 0; k < scanners_.size(); ++k) {
+                    scn.p_ = p;
+                    auto s = scanners_[k]->match_();
+                    if (s.size() > best) {
+                        best = s.size();
+                        best_id = scanners_[k]->token_id_;
+                        best_value = scn.value_;
+                        best_scanners = 0;
+                    }
+                    if (!s.empty() && s.size() == best)
+                        best_scanners |= uint64_t(1) << k;
+                    scn.value_ = {};
+                }
+                scn.p_ = begin;
+
+                if (!best) {
+                    log::lexer_error(p, end);
+                    return std::nullopt;
+                }
+                tokens.lexemes.push_back({best_id, uint32_t(p - begin), uint32_t(best), std::move(best_value), best_scanners});
+                p += best;
+            }
+            return tokens;
+        }
+    };
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include "arena_ptr.h"
+#include "ast.h"
+#include "bracket_index.h"
+#include "error_messages.h"
+#include "grammar_walk.h"
+#include "parser.h"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace onek {
+
+    namespace detail {
+
+        // Offsets of the separators that are not inside brackets, brackets
+        // lists the pairs as for bracket_index. Only the bytes of interest are
+        // looked at one by one, the rest of the text is skipped 16 bytes at a
+        // time. Quotes are not taken into account.
+        inline std::vector<size_t> split_points(std::string_view text, char separator, std::string_view brackets = "()[]{}") {
+            assert(brackets.find(separator) == std::string_view::npos);
+            auto const kind = bracket_kinds(brackets);
+            std::vector<size_t> points;
+            int depth = 0;
+            auto visit = [&](char c, size_t i) {
+                if (c == separator && depth <= 0)
+                    points.push_back(i);
+                else if (signed char k = kind[(unsigned char)c])
+                    depth += k > 0 ? 1 : -1;
+            };
+
+            char const *p = text.data();
+            size_t const n = text.size();
+            size_t i = 0;
+#if defined(__SSE2__)
+            // the separator and up to 7 pairs, more are left to the loop below
+            __m128i special[16];
+            size_t const count = std::min<size_t>(brackets.size(), 15);
+            special[0] = _mm_set1_epi8(separator);
+            for (size_t k = 0; k < count; ++k)
+                special[k + 1] = _mm_set1_epi8(brackets[k]);
+            for (; brackets.size() < 16 && i + 16 <= n; i += 16) {
+                __m128i bytes = _mm_loadu_si128(reinterpret_cast<__m128i const *>(p + i));
+                __m128i hits = _mm_setzero_si128();
+                for (size_t k = 0; k <= count; ++k)
+                    hits = _mm_or_si128(hits, _mm_cmpeq_epi8(bytes, special[k]));
+                for (auto mask = unsigned(_mm_movemask_epi8(hits)); mask; mask &= mask - 1) {
+                    size_t k = i + std::countr_zero(mask);
+                    visit(p[k], k);
+                }
+            }
+#endif
+            for (; i < n; ++i)
+                visit(p[i], i);
+            return points;
+        }
+
+        inline std::string_view trim(std::string_view s) noexcept {
+            while (!s.empty() && is_space(s.front()))
+                s.remove_prefix(1);
+            while (!s.empty() && is_space(s.back()))
+                s.remove_suffix(1);
+            return s;
+        }
+    }
+
+    // Parses a text of independent units, e.g. statements, on several threads.
+    // The grammar of one unit declares the separator with separate_units.
+    // make_grammar(scan_state &) is called once per thread, because the
+    // terminals of a grammar are bound to one scan state. The units are split
+    // at the separators outside of the brackets the grammar declares, see
+    // declared_brackets, parsed into separate trees and joined in input order
+    // under a root with the given action.
+    // The text must outlive the tree. Identifiers are not interned, an
+    // intern_table must not be shared by threads.
+    template<typename G, typename Action>
+    auto parse_parallel(std::string_view text, G const &make_grammar, Action &&action, char const *name = "units", unsigned threads = 0) {
+        using C = typename std::invoke_result_t<G const &, scan_state &>::element_type;
+        using F = typename C::configuration;
+        using A = ast<F>;
+
+        char separator = 0;
+        std::string brackets;
+        {
+            auto scn = scan_state(text);
+            auto grammar = make_grammar(scn);
+            auto handle = arena_handle(grammar);
+            handle.set_destroy_arena_on_scope_exit();
+            separator = grammar->unit_separator_;
+            brackets = declared_brackets<F>(grammar.get());
+        }
+        assert(separator && "declare the unit separator of the grammar with separate_units");
+
+        std::vector<std::string_view> units;
+        size_t begin = 0;
+        auto add_unit = [&](size_t end) {
+            if (auto unit = detail::trim(text.substr(begin, end - begin)); !unit.empty())
+                units.push_back(unit);
+            begin = end + 1;
+        };
+        for (size_t point : detail::split_points(text, separator, brackets))
+            add_unit(point);
+        add_unit(text.size());
+
+        if (!threads)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        threads = unsigned(std::min<size_t>(threads, units.size()));
+
+        // units are handed out in batches, small enough to balance the load
+        std::vector<std::optional<A>> results(units.size());
+        size_t const batch = std::max<size_t>(1, units.size() / (size_t(threads) * 8));
+        std::atomic<size_t> next{0};
+        auto work = [&]() {
+            auto scn = scan_state(std::string_view{});
+            auto grammar = make_grammar(scn);
+            auto handle = arena_handle(grammar);
+            handle.set_destroy_arena_on_scope_exit();
+            for (size_t first; (first = next.fetch_add(batch)) < units.size();) {
+                for (size_t i = first; i < std::min(first + batch, units.size()); ++i) {
+                    scn.reset(units[i]);
+                    results[i] = grammar->parse(scn, nullptr, false);
+                }
+            }
+        };
+        {
+            std::vector<std::jthread> pool;
+            for (unsigned t = 1; t < threads; ++t)
+                pool.emplace_back(work);
+            work();
+        }
+
+        std::vector<A> parts;
+        parts.reserve(results.size());
+        for (size_t i = 0; i < results.size(); ++i) {
+            if (!results[i]) {
+                log::unit_failure(i, units[i]);
+                return std::optional<A>{};
+            }
+            parts.push_back(std::move(*results[i]));
+        }
+        return std::optional<A>{A::join(std::move(parts), std::forward<Action>(action), name)};
+    }
+}
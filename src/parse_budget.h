@@ -0,0 +1,88 @@
+#pragma once
+
+#include "error_messages.h"
+#include "scan_state.h"
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stop_token>
+
+namespace onek {
+
+    struct budget_limits {
+        uint64_t max_steps = std::numeric_limits<uint64_t>::max();// composed productions entered
+        uint64_t max_rescanned_bytes = std::numeric_limits<uint64_t>::max();// input given back by backtracking
+        std::chrono::nanoseconds max_time = std::chrono::nanoseconds::max();// from construction or restart
+    };
+
+    // Opt-in bound on the work of a parse, enabled by pointing scan_state::budget_
+    // to an instance. Exhausting it aborts the parse with parse_status::budget_exceeded,
+    // a stop request on the stop token with parse_status::cancelled. The clock and
+    // the stop token are only looked at every check_interval steps.
+    class parse_budget {
+        using clock = std::chrono::steady_clock;
+        static constexpr uint64_t check_interval = 1024;
+
+        budget_limits limits_;
+        std::stop_token stop_;
+        clock::time_point deadline_;
+        uint64_t steps_ = 0;
+        uint64_t rescanned_bytes_ = 0;
+        char const *production_ = nullptr;// the named production entered last
+        char const *exhausted_ = nullptr;
+
+        bool stop(scan_state &scn, parse_status status, char const *reason) noexcept {
+            if (!scn.is_aborted()) {
+                exhausted_ = reason;
+                scn.status_ = status;
+                log::budget_exhausted(reason, stopped_in(), scn.line_number_, scn.line_begin_, scn.scanner_end_);
+            }
+            return false;
+        }
+
+        public:
+        explicit parse_budget(budget_limits const &limits = {}, std::stop_token stop = {}) noexcept
+            : limits_(limits), stop_(std::move(stop)) {
+            restart();
+        }
+
+        // for the next parse
+        void restart() noexcept {
+            auto now = clock::now();
+            deadline_ = limits_.max_time >= clock::time_point::max() - now ? clock::time_point::max() : now + limits_.max_time;
+            steps_ = 0;
+            rescanned_bytes_ = 0;
+            production_ = nullptr;
+            exhausted_ = nullptr;
+        }
+
+        [[nodiscard]] uint64_t steps() const noexcept { return steps_; }
+        [[nodiscard]] uint64_t rescanned_bytes() const noexcept { return rescanned_bytes_; }
+        [[nodiscard]] char const *exhausted() const noexcept { return exhausted_; }// "steps", "rescanned bytes", "deadline" or "cancelled"
+        [[nodiscard]] char const *stopped_in() const noexcept { return production_ ? production_ : "unknown"; }
+
+        // entering a production
+        bool step(scan_state &scn, char const *production) noexcept {
+            if (production && strcmp(production, "unknown") != 0)
+                production_ = production;
+            if (++steps_ > limits_.max_steps)
+                return stop(scn, parse_status::budget_exceeded, "steps");
+            if (steps_ % check_interval == 1) {
+                if (stop_.stop_requested())
+                    return stop(scn, parse_status::cancelled, "cancelled");
+                if (clock::now() >= deadline_)
+                    return stop(scn, parse_status::budget_exceeded, "deadline");
+            }
+            return true;
+        }
+
+        // a production gives back input that will be scanned again
+        bool backtrack(scan_state &scn, size_t bytes) noexcept {
+            rescanned_bytes_ += bytes;
+            if (rescanned_bytes_ > limits_.max_rescanned_bytes)
+                return stop(scn, parse_status::budget_exceeded, "rescanned bytes");
+            return true;
+        }
+    };
+}
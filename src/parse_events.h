@@ -0,0 +1,56 @@
+#pragma once
+
+#include "token.h"
+#include <cstring>
+#include <functional>
+#include <string_view>
+
+namespace onek {
+
+    // what a parse produces, see ast::add_node
+    enum class parse_mode : unsigned char {
+        tree,     // the ast
+        recognize,// nothing, the parse only tells whether the text matches
+        events    // calls to parse_events, no nodes are created
+    };
+
+    // SAX style callbacks. enter and exit are called for named productions,
+    // token for every matched terminal. Each callback is optional.
+    struct parse_events {
+        std::function<void(char const *production)> enter;
+        std::function<void(char const *production)> exit;
+        std::function<void(token_id, std::string_view, token_value const &)> token;
+    };
+
+    enum class parse_event_kind : unsigned char {
+        enter,
+        exit,
+        token
+    };
+
+    // an event that is held back while backtracking may still take it back
+    struct parse_event {
+        parse_event_kind kind;
+        token_id token;
+        char const *name;
+        std::string_view text;
+        token_value value;
+
+        void deliver(parse_events const &events) const {
+            switch (kind) {
+                case parse_event_kind::enter:
+                    if (events.enter) events.enter(name);
+                    break;
+                case parse_event_kind::exit:
+                    if (events.exit) events.exit(name);
+                    break;
+                case parse_event_kind::token:
+                    if (events.token) events.token(token, text, value);
+                    break;
+            }
+        }
+    };
+
+    // productions without a name are the wrappers the combinators create
+    inline bool is_named_production(char const *name) noexcept { return name && strcmp(name, "unknown") != 0; }
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include "ast_graph.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <ostream>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace onek {
+
+    struct production_stats {
+        uint64_t attempts = 0;
+        uint64_t successes = 0;
+        uint64_t failures = 0;
+        uint64_t backtracks = 0;       // attempts that had consumed input or created nodes and had to give them back
+        uint64_t bytes_discarded = 0;  // input consumed and then given back
+        uint64_t nodes_rolled_back = 0;// ast nodes created and then erased
+        std::chrono::nanoseconds cumulative_time{};
+        std::chrono::nanoseconds self_time{};
+        size_t active_ = 0;// recursion depth, cumulative time is only counted for the outermost call
+    };
+
+    // Opt-in profiler, enabled by pointing scan_state::profiler_ to an instance.
+    // Productions are identified by name. Anonymous productions, i.e. the ones
+    // created by operator>> and operator| that were not named by prod, are not
+    // reported on their own, their cost is added to the enclosing named production.
+    class parse_profiler {
+        using clock = std::chrono::steady_clock;
+        struct frame {
+            production_stats *stats;// nullptr for anonymous productions
+            clock::time_point start;
+            clock::duration children;
+            char const *p;
+            size_t nodes;
+        };
+        std::unordered_map<std::string_view, production_stats> stats_;
+        std::vector<frame> stack_;
+
+        public:
+        void enter(char const *name, char const *p, size_t nodes) {
+            production_stats *stats = nullptr;
+            if (name && strcmp(name, "unknown") != 0) {
+                stats = &stats_[name];
+                ++stats->attempts;
+                ++stats->active_;
+            }
+            stack_.push_back({stats, clock::now(), clock::duration::zero(), p, nodes});
+        }
+
+        // to be called before the parser restores its saved state
+        void rollback(char const *p, size_t nodes) {
+            frame const &f = stack_.back();
+            if (!f.stats)
+                return;
+            auto bytes = p > f.p ? uint64_t(p - f.p) : 0;
+            auto erased = nodes > f.nodes ? nodes - f.nodes : 0;
+            if (bytes || erased) {
+                ++f.stats->backtracks;
+                f.stats->bytes_discarded += bytes;
+                f.stats->nodes_rolled_back += erased;
+            }
+        }
+
+        void leave(bool success) {
+            frame f = stack_.back();
+            stack_.pop_back();
+            auto elapsed = clock::now() - f.start;
+            auto *parent = stack_.empty() ? nullptr : &stack_.back();
+            if (!f.stats) {
+                if (parent)
+                    parent->children += f.children;
+                return;
+            }
+            ++(success ? f.stats->successes : f.stats->failures);
+            f.stats->self_time += elapsed - f.children;
+            if (--f.stats->active_ == 0)
+                f.stats->cumulative_time += elapsed;
+            if (parent)
+                parent->children += elapsed;
+        }
+
+        [[nodiscard]] std::vector<std::pair<std::string_view, production_stats>> sorted() const {
+            std::vector<std::pair<std::string_view, production_stats>> v(stats_.begin(), stats_.end());
+            std::sort(v.begin(), v.end(), [](auto const &l, auto const &r) { return l.second.self_time > r.second.self_time; });
+            return v;
+        }
+
+        // productions sorted by self time, most expensive first
+        void report(std::ostream &os) const {
+            auto ms = [](std::chrono::nanoseconds t) { return double(t.count()) / 1e6; };
+            os << std::left << std::setw(24) << "production" << std::right
+               << std::setw(10) << "attempts" << std::setw(10) << "success" << std::setw(10) << "failure"
+               << std::setw(11) << "backtrack" << std::setw(12) << "bytes disc." << std::setw(12) << "nodes disc."
+               << std::setw(12) << "cumul. ms" << std::setw(12) << "self ms" << '\n';
+            for (auto const &[name, s] : sorted()) {
+                os << std::left << std::setw(24) << name << std::right
+                   << std::setw(10) << s.attempts << std::setw(10) << s.successes << std::setw(10) << s.failures
+                   << std::setw(11) << s.backtracks << std::setw(12) << s.bytes_discarded << std::setw(12) << s.nodes_rolled_back
+                   << std::fixed << std::setprecision(3)
+                   << std::setw(12) << ms(s.cumulative_time) << std::setw(12) << ms(s.self_time) << '\n';
+            }
+        }
+
+        void write_json(std::ostream &os) const {
+            os << '[';
+            bool first = true;
+            for (auto const &[name, s] : sorted()) {
+                os << (first ? "" : ",") << "{\"production\":\"";
+                detail::write_escaped(os, name, true);
+                os << "\",\"attempts\":" << s.attempts << ",\"successes\":" << s.successes << ",\"failures\":" << s.failures
+                   << ",\"backtracks\":" << s.backtracks << ",\"bytes_discarded\":" << s.bytes_discarded
+                   << ",\"nodes_rolled_back\":" << s.nodes_rolled_back
+                   << ",\"cumulative_ns\":" << s.cumulative_time.count() << ",\"self_ns\":" << s.self_time.count() << '}';
+                first = false;
+            }
+            os << "]\n";
+        }
+
+        [[nodiscard]] production_stats const *find(std::string_view name) const {
+            auto it = stats_.find(name);
+            return it == stats_.end() ? nullptr : &it->second;
+        }
+
+        void clear() {
+            stats_.clear();
+            stack_.clear();
+        }
+    };
+}
@@ -2,8 +2,14 @@
 
 #include "ast.h"
 #include "ast_node.h"
+#include "bracket_index.h"
 #include "scan_state.h"
+#include "scanners.h"
+#include "symbol_table.h"
 #include "error_messages.h"
+#include "parse_budget.h"
+#include "parse_profiler.h"
+#include "resource_limits.h"
 #include <array>
 #include <functional>
 #include <optional>
@@ -11,12 +17,211 @@
 #include <string_view>
 #include <algorithm>
 #include <regex>
+#include <utility>
 
 namespace onek {
 
     template<typename F>
     class composed_parser;
 
+    template<typename F>
+    class frozen_grammar;
+    template<typename F>
+    class lexer;
+
+    // how a composed parser combines its children, see parser_combinators.h
+    enum class combinator : unsigned short {
+        custom,
+        sequence,
+        alternative,
+        cut,
+        list,// item % separator
+        trailing_list// item % separator, the last item may be followed by a separator
+    };
+
+    namespace detail {
+
+        inline std::string_view literal_view(char const *s) noexcept { return s ? s : std::string_view{}; }
+        inline std::string_view literal_view(std::string_view s) noexcept { return s; }
+
+        // skips whitespace and matches the first of the literals that fits.
+        // The list of literals ends at the first empty literal or nullptr.
+        template<typename Literals>
+        std::string_view match_literals(scan_state &scn, Literals const &literals) noexcept {
+            char const *backup = scn.p_;
+            while (scn.p_ < scn.scanner_end_ && is_space(*scn.p_))
+                ++(scn.p_);
+            size_t available = scn.scanner_end_ - scn.p_;
+            for (auto const &l : literals) {
+                std::string_view s = literal_view(l);
+                if (s.empty()) break;
+                if (s.size() <= available && !memcmp(scn.p_, s.data(), s.size())) {
+                    auto start = scn.p_;
+                    scn.p_ += s.size();
+                    return {start, scn.p_};
+                }
+            }
+            scn.p_ = backup;
+            return {};
+        }
+
+        // to be called when the right side of a cut did not match
+        inline void cut_failure(scan_state &scn) noexcept {
+            if (scn.is_aborted())
+                return;
+            scn.status_ = parse_status::cut_failure;
+            log::cut_failure(scn.cut_point_, scn.line_number_, scn.line_begin_, scn.scanner_end_);
+        }
+
+        // Matches item (separator item)* in one loop. Each iteration only saves
+        // and restores constant size state, so long lists parse in linear time.
+        // A separator that is not followed by an item is given back, unless
+        // trailing separators are allowed.
+        template<typename F, typename I, typename S>
+        bool parse_list(ast<F> &a, scan_state &scn, ast_node<F> *ast_parent, bool reportErrors, bool trailing, I &&item, S &&separator) noexcept {
+            if (!item(reportErrors))
+                return false;
+            while (true) {
+                auto const scn_status = status_saver(scn);
+                auto const ast_status = status_saver<ast<F>>(a, ast_parent);
+                typename ast<F>::choice_point const choice(a);
+                if (!separator(false))
+                    return !scn.is_aborted();
+                if (!item(false)) {
+                    if (scn.is_aborted())
+                        return false;
+                    if (!trailing) {
+                        scn_status.restore_to(scn);
+                        ast_status.restore_to(a);
+                    }
+                    return true;
+                }
+            }
+        }
+
+        // Parses a composed production: saves the state in case we have to backtrack,
+        // creates the ast node and matches the production min_repeat to max_repeat times.
+        // match_once(node, reportErrors) matches the children of the production once.
+        // Shared by composed_parser and frozen_grammar.
+        template<typename F, typename M>
+        bool parse_composed(ast<F> &a, scan_state &scn, ast_node<F> *ast_parent, bool reportErrors,
+                            char const *name, unsigned short flags, typename ast_node<F>::action_function const &action,
+                            size_t min_repeat, size_t max_repeat, char const *delim_, M &&match_once) noexcept {
+            using N = ast_node<F>;
+
+            if (scn.budget_ && !scn.budget_->step(scn, name))
+                return false;
+            if (scn.resources_ && !scn.resources_->enter(scn))
+                return false;
+            struct leave_on_exit {
+                resource_guard *resources;
+                ~leave_on_exit() {
+                    if (resources)
+                        resources->leave();
+                }
+            } const depth{scn.resources_};
+
+            // a production that may match nothing is a choice point until it matched once
+            bool optional_open = min_repeat == 0;
+            if (optional_open)
+                a.open_choice();
+            auto close_optional = [&]() {
+                if (std::exchange(optional_open, false))
+                    a.close_choice();
+            };
+
+            // saving status in case we have to backtrack
+            char const *const start = scn.p_;
+            auto const scn_status = status_saver(scn);
+            auto const ast_status = status_saver<ast<F>>(a, ast_parent);//to-do - write deduction guide
+
+            log::log_parser_blockentry(name, scn.p_, scn.scanner_end_);
+            if (scn.profiler_)
+                scn.profiler_->enter(name, scn.p_, a.memory_.size());
+            auto log_parser_failure = [&]() {
+                if (scn.profiler_) {
+                    scn.profiler_->rollback(scn.p_, a.memory_.size());
+                    scn.profiler_->leave(false);
+                }
+                if (scn.resources_)
+                    scn.resources_->backtrack(scn);
+                if (scn.budget_ && scn.p_ > start)
+                    scn.budget_->backtrack(scn, scn.p_ - start);
+                scn_status.restore_to(scn);
+                ast_status.restore_to(a);
+                close_optional();
+                log::log_parser_blockexit_failure(name);
+                return false;
+            };
+
+            // if we are allowed to not match anything,
+            // then not matching anything is not an error
+            if (min_repeat == 0)
+                reportErrors = false;
+
+            N *node = a.add_node(action, token_id::composed, name, ast_parent, std::string_view{}, flags);
+            if (scn.resources_ && !scn.resources_->grow(scn, a.memory_.size(), sizeof(N)))
+                return log_parser_failure();
+
+            // trying to match this node the minimum required times
+
+            const char *delim = nullptr;
+            size_t i = 0;
+            for (; i < min_repeat; ++i) {
+                if (delim && !scn.match_delimiter(delim)) {
+                    log::scanner_match_error(token_id::delimiter, delim, scn.line_number_, scn.line_begin_, scn.scanner_end_, reportErrors);
+                    return log_parser_failure();
+                }
+                if (!match_once(node, reportErrors))
+                    return log_parser_failure();
+                delim = delim_;
+            }
+
+            // matching as much as we can until max repeat reached
+            // we us a big number instead of infinity, i.e. this src will
+            // break if it sees a functions with more than a billion parameters.
+
+            bool dropped = false;
+            for (; i < max_repeat; ++i) {
+                if (delim) {
+                    if (!scn.match_delimiter(delim))
+                        break;
+                    if (!match_once(node, false))
+                        return log_parser_failure();
+                } else {
+                    // an iteration that does not match completely is given back
+                    auto const scn_iteration = status_saver(scn);
+                    auto const ast_iteration = status_saver<ast<F>>(a, node);
+                    typename ast<F>::choice_point const choice(a);
+                    if (!match_once(node, false)) {
+                        if (scn.is_aborted())
+                            return log_parser_failure();
+                        if (i == 0) {// drop composed nodes that have no children but return success
+                            if (scn.profiler_)
+                                scn.profiler_->rollback(scn.p_, a.memory_.size());
+                            scn_status.restore_to(scn);
+                            ast_status.restore_to(a);
+                            dropped = true;
+                        } else {
+                            scn_iteration.restore_to(scn);
+                            ast_iteration.restore_to(a);
+                        }
+                        break;
+                    }
+                }
+                close_optional();
+                delim = delim_;
+            }
+            if (!dropped)
+                a.end_node(name);
+            close_optional();
+            log::log_parser_blockexit_success(name);
+            if (scn.profiler_)
+                scn.profiler_->leave(true);
+            return true;
+        }
+    }
+
     template<typename F>
     class terminal_parser;
 
@@ -47,6 +252,8 @@ namespace onek {
 
         FilterType filters_{nullptr, nullptr, nullptr, nullptr, nullptr};// todo: think of something better
         ushort flags_ = FLAG_NONE;
+        bool literal_match_ = false;// match_ matches filters_ only, see frozen_grammar
+        bool lexable_ = false;// matches independent of the parse context, see lexer.h
         using match_function = std::function<std::string_view()>;
         match_function match_;
 
@@ -57,14 +264,14 @@ namespace onek {
             : name_(token_to_string(token_id_)), token_id_(token_id_), flags_(flags), match_(std::move(match)){};
 
         terminal_parser(token_id token_id_, scan_state &scn, char const *match, ushort flags = FLAG_NONE)
-            : name_(token_to_string(token_id_)), token_id_(token_id_), flags_(flags) {
+            : name_(token_to_string(token_id_)), token_id_(token_id_), flags_(flags), lexable_(true) {
 
             match_ = [match, &scn]() -> std::string_view {
                 auto r = std::regex(match);
                 if (scn.p_ >= scn.scanner_end_) return {};
                 auto b = std::match_results<std::string_view::const_iterator>{};
                 char const *backup = scn.p_;
-                while (scn.p_ < scn.scanner_end_ && strchr(" \n\t\r\a", *scn.p_))
+                while (scn.p_ < scn.scanner_end_ && is_space(*scn.p_))
                     ++(scn.p_);
                 auto x = std::string_view(scn.p_, scn.scanner_end_);
                 if (std::regex_search(x.cbegin(), x.cend(), b, r)) {
@@ -80,81 +287,136 @@ namespace onek {
             };
         }
 
+        terminal_parser(token_id token_id_, scan_state &scn, number_format format, ushort flags = FLAG_NONE)
+            : name_(token_to_string(token_id_)), token_id_(token_id_), flags_(flags), lexable_(true) {
+            match_ = [&scn, format, allow_sign = bool(flags & FLAG_SIGNED)]() -> std::string_view {
+                return scan_number(scn, format, allow_sign);
+            };
+        }
+
         terminal_parser(token_id token_id_, match_function match, FilterType filters_, ushort flags = FLAG_NONE)
             : name_(token_to_string(token_id_)), token_id_(token_id_), filters_(filters_), flags_(flags), match_(std::move(match)){};
 
         terminal_parser(token_id token_id_, scan_state &scn, FilterType const &filters, ushort flags = FLAG_NONE)
-            : name_(token_to_string(token_id_)), token_id_(token_id_), filters_(filters), flags_(flags) {
+            : name_(token_to_string(token_id_)), token_id_(token_id_), filters_(filters), flags_(flags), literal_match_(true), lexable_(true) {
             match_ = [&scn, this]() -> std::string_view {
-                char const *backup = scn.p_;
-                while (scn.p_ < scn.scanner_end_ && strchr(" \n\t\r\a", *scn.p_))
-                    ++(scn.p_);
-                for (char const *s : filters_) {
-                    if (!s) break;
-                    size_t len = std::min(long(strlen(s)), long(scn.scanner_end_ - scn.p_));
-                    if (len < 1) break;
-                    if (!strncmp(scn.p_, s, len)) {
-                        auto start = scn.p_;
-                        auto end = start + strlen(s);
-                        scn.p_ = end;
-                        return {start, end};
-                    }
-                }
-                scn.p_ = backup;
-                return {};
+                return detail::match_literals(scn, filters_);
             };
         }
 
         [[nodiscard]] bool isComposed() const override { return false; }
 
+        // value of the token just matched, for the ast node
+        token_value take_value(scan_state &scn, std::string_view tokenstr) const {
+            if (token_id_ == token_id::ident && scn.symbols_)
+                return scn.symbols_->intern(tokenstr);
+            return std::exchange(scn.value_, {});
+        }
+
+        // token mode: literals match the text of the next lexeme, other terminals
+        // lexemes of their token id that their own scanner matched when lexing.
+        // The list of literals ends like in detail::match_literals.
+        template<typename Literals>
+        std::string_view match_token(scan_state &scn, Literals const &literals) const noexcept {
+            auto const *l = scn.peek_token();
+            if (!l)
+                return {};
+            if (!literal_match_)
+                return l->token == token_id_ && scn.tokens_->scanned_by(*l, this) ? scn.take_token() : std::string_view{};
+            auto text = scn.tokens_->text_of(*l);
+            for (auto const &f : literals) {
+                std::string_view s = detail::literal_view(f);
+                if (s.empty())
+                    break;
+                if (text == s)
+                    return scn.take_token();
+            }
+            return {};
+        }
+
         bool parse(A &a, scan_state &scn, N *ast_parent, bool reportErrors = false) const noexcept override {
-            // see next overload of function parse for comments
+            return parse_with(a, scn, ast_parent, reportErrors, match_, filters_);
+        }
+
+        // parse this terminal but match the token with another function and
+        // other literals, used by frozen_grammar to match with its own literal tables
+        template<typename M, typename Literals>
+        bool parse_with(A &a, scan_state &scn, N *ast_parent, bool reportErrors, M const &match_, Literals const &literals) const noexcept {
+            // see detail::parse_composed for comments
+
+            // terminals with a custom match function, e.g. the_end, are not lexed
+            auto next = [&]() -> std::string_view {
+                if (scn.tokens_)
+                    return lexable_ ? match_token(scn, literals) : match_();
+                if (scn.brackets_ && (token_id_ == token_id::open || token_id_ == token_id::close))
+                    return detail::match_bracket(scn, token_id_ == token_id::open, match_);
+                return match_();
+            };
 
             if (min_repeat_ == 0)
                 reportErrors = false;
 
+            if (scn.profiler_)
+                scn.profiler_->enter(name_, scn.p_, a.memory_.size());
+            auto profile_failure = [&]() {
+                if (scn.profiler_) {
+                    scn.profiler_->rollback(scn.p_, a.memory_.size());
+                    scn.profiler_->leave(false);
+                }
+                return false;
+            };
+            auto grown = [&]() { return !scn.resources_ || scn.resources_->grow(scn, a.memory_.size(), sizeof(N)); };
+
             const char *delim = nullptr;
             size_t i = 0;
             for (; i < min_repeat_; ++i) {
                 if (delim && !scn.match_delimiter(delim)) {
                     log::scanner_match_error(token_id::delimiter, delim, scn.line_number_, scn.line_begin_, scn.scanner_end_, reportErrors);
-                    return false;
+                    return profile_failure();
                 }
 
-                std::string_view tokenstr = match_();
+                std::string_view tokenstr = next();
                 if (tokenstr.empty()) {
                     log::scanner_match_error(token_id_, filters_, scn.line_number_, scn.line_begin_, scn.scanner_end_, reportErrors);
-                    return false;
+                    return profile_failure();
                 }
-                a.add_node(F::default_action, token_id_, token_to_string(token_id_), ast_parent, tokenstr, FLAG_ACTION_PARENT & flags_);
+                a.add_node(F::default_action, token_id_, token_to_string(token_id_), ast_parent, tokenstr, FLAG_ACTION_PARENT & flags_, take_value(scn, tokenstr));
+                if (!grown())
+                    return profile_failure();
                 log::scanner_match_success(token_id_, filters_, tokenstr);
                 delim = delim_;
             }
 
             for (; i < max_repeat_; ++i) {
                 if (delim) {
-                    if (scn.match_delimiter(delim)) {
-                        std::string_view tokenstr = match_();
-                        if (tokenstr.empty()) {
-                            log::scanner_match_empty(token_id::delimiter, delim);
-                            return false;
-                        }
-                        a.add_node(F::default_action, token_id_, "anonymous", ast_parent, tokenstr, FLAG_ACTION_PARENT & flags_);
-                        log::scanner_match_success(token_id::delimiter, filters_, tokenstr);
+                    if (!scn.match_delimiter(delim))
+                        break;
+                    std::string_view tokenstr = next();
+                    if (tokenstr.empty()) {
+                        log::scanner_match_empty(token_id::delimiter, delim);
+                        return profile_failure();
                     }
+                    a.add_node(F::default_action, token_id_, "anonymous", ast_parent, tokenstr, FLAG_ACTION_PARENT & flags_, take_value(scn, tokenstr));
+                    if (!grown())
+                        return profile_failure();
+                    log::scanner_match_success(token_id::delimiter, filters_, tokenstr);
                 } else {
-                    std::string_view tokenstr = match_();
+                    std::string_view tokenstr = next();
                     if (tokenstr.empty()) {
                         if (i == 0)// drop composed nodes that have no children but return success
                             ;      // ast_status.restore_to(a);
                         log::scanner_match_empty(token_id_, filters_);
                         break;
                     }
-                    a.add_node(F::default_action, token_id_, "anonymous", ast_parent, tokenstr, FLAG_ACTION_PARENT & flags_);
+                    a.add_node(F::default_action, token_id_, "anonymous", ast_parent, tokenstr, FLAG_ACTION_PARENT & flags_, take_value(scn, tokenstr));
+                    if (!grown())
+                        return profile_failure();
                     log::scanner_match_success(token_id_, filters_, tokenstr);
                 }
                 delim = delim_;
             }
+            if (scn.profiler_)
+                scn.profiler_->leave(true);
             return true;
         }
     };
@@ -175,10 +437,15 @@ namespace onek {
         using combined_match_ = std::function<bool(B *, B *, A &a, scan_state &scn, N *ast_parent, bool expectFlag)>;
         combined_match_ match_;
 
+        friend class frozen_grammar<F>;
+        friend class lexer<F>;
+
         public:
         N::action_function action_ = F::default_action;
         const char *name_ = "unknown";
         ushort flags_ = FLAG_NONE;
+        combinator kind_ = combinator::custom;
+        char unit_separator_ = 0;// separates independent top-level units, see parallel_parse.h
 
         using configuration = F;
 
@@ -187,8 +454,8 @@ namespace onek {
 
         composed_parser(C const &) = default;
 
-        composed_parser(combined_match_ match, B *left, B *right)
-            : match_(match), left_(left), right_(right) {
+        composed_parser(combined_match_ match, B *left, B *right, combinator kind = combinator::custom)
+            : match_(match), kind_(kind), left_(left), right_(right) {
         }
 
         explicit composed_parser(const char *name, ushort flags)
@@ -198,74 +465,36 @@ namespace onek {
         [[nodiscard]] bool isComposed() const override { return true; }
 
         std::optional<A> parse(scan_state &scn, N *ast_parent, bool reportErrors) noexcept {
-            A a;
+            if (!detail::begin_parse(scn))
+                return std::nullopt;
+            A a(scn.ast_memory_);
             if (parse(a, scn, ast_parent, reportErrors))
                 return a;
             else
                 return std::nullopt;
         }
 
-        bool parse(A &a, scan_state &scn, N *ast_parent, bool reportErrors) const noexcept override {
-
-            // saving status in case we have to backtrack
-            auto const scn_status = status_saver(scn);
-            auto const ast_status = status_saver<ast<F>>(a, ast_parent);//to-do - write deduction guide
-
-            log::log_parser_blockentry(name_, scn.p_, scn.scanner_end_);
-            auto log_parser_failure = [&]() {
-                scn_status.restore_to(scn);
-                ast_status.restore_to(a);
-                log::log_parser_blockexit_failure(name_);
+        // whether the text matches, without creating any nodes
+        bool recognize(scan_state &scn, bool reportErrors) noexcept {
+            if (!detail::begin_parse(scn))
                 return false;
-            };
-
-            // if we are allowed to not match anything,
-            // then not matching anything is not an error
-            if (min_repeat_ == 0)
-                reportErrors = false;
-
-            N *node = a.add_node(action_, token_id::composed, name_, ast_parent, std::string_view{}, flags_);
-
-            // trying to match this node the minimum required times
-
-            const char *delim = nullptr;
-            size_t i = 0;
-            for (; i < min_repeat_; ++i) {
-                if (delim && !scn.match_delimiter(delim)) {
-                    log::scanner_match_error(token_id::delimiter, delim, scn.line_number_, scn.line_begin_, scn.scanner_end_, reportErrors);
-                    return log_parser_failure();
-                }
-                if (!match_(left_, right_, a, scn, node, reportErrors))
-                    return log_parser_failure();
-                delim = delim_;
-            }
+            A a(nullptr, parse_mode::recognize);
+            return parse(a, scn, nullptr, reportErrors);
+        }
 
-            // matching as much as we can until max repeat reached
-            // we us a big number instead of infinity, i.e. this src will
-            // break if it sees a functions with more than a billion parameters.
+        // calls events instead of building the ast, see parse_events.h.
+        // Events are only delivered for matches that backtracking can not
+        // take back anymore; if the parse fails, some may have been delivered.
+        bool parse(scan_state &scn, parse_events const &events, bool reportErrors) {
+            if (!detail::begin_parse(scn))
+                return false;
+            A a(nullptr, parse_mode::events, &events);
+            return parse(a, scn, nullptr, reportErrors);
+        }
 
-            for (; i < max_repeat_; ++i) {
-                if (delim) {
-                    if (scn.match_delimiter(delim)) {
-                        if (!match_(left_, right_, a, scn, node, false)) {
-                            scn_status.restore_to(scn);
-                            ast_status.restore_to(a);
-                            return log_parser_failure();
-                        }
-                    }
-                } else {
-                    if (!match_(left_, right_, a, scn, node, false)) {
-                        if (i == 0) {// drop composed nodes that have no children but return success
-                            scn_status.restore_to(scn);
-                            ast_status.restore_to(a);
-                        }
-                        break;
-                    }
-                }
-                delim = delim_;
-            }
-            log::log_parser_blockexit_success(name_);
-            return true;
+        bool parse(A &a, scan_state &scn, N *ast_parent, bool reportErrors) const noexcept override {
+            return detail::parse_composed(a, scn, ast_parent, reportErrors, name_, flags_, action_, min_repeat_, max_repeat_, delim_,
+                                          [&](N *node, bool expectFlag) { return match_(left_, right_, a, scn, node, expectFlag); });
         }
 
         void copy_bahaviour(C * n) {
@@ -273,11 +502,14 @@ namespace onek {
             // no placeholder-placeholder
             assert(flags_ & FLAG_PLACEHOLDER && !(n->flags_ & FLAG_PLACEHOLDER));
 
-            // copy all members except the repeat counts, parent node and flags
+            // copy all members except the repeat counts, parent node and flags.
+            // Purity belongs to the action, so it is copied with it.
             delim_ = n->delim_;
             name_ = n->name_;
             match_ = n->match_;
+            kind_ = n->kind_;
             action_ = n->action_;
+            flags_ |= n->flags_ & FLAG_PURE;
             left_ = n->left_;
             right_ = n->right_;
         }
@@ -4,11 +4,16 @@
 #include "ast_node.h"
 #include "scan_state.h"
 #include "arena_ptr.h"
+#include <concepts>
 #include <memory>
 #include <type_traits>
 
 namespace onek {
 
+    // an arena_ptr to a parser, the operands of the grammar operators
+    template<typename P>
+    concept parser_ptr = std::derived_from<typename P::element_type, parser_base<typename P::element_type::configuration>>;
+
     template<typename L, typename R>
     auto operator>>(L left, R right) {
         using F = typename L::element_type::configuration;
@@ -22,7 +27,7 @@ namespace onek {
                    && right->parse(a, s, ast_parent, expectFlag);
         };
         auto h = arena_handle(left);
-        return make_arena_ptr<C>(h, f, left.get(), right.get());
+        return make_arena_ptr<C>(h, f, left.get(), right.get(), combinator::sequence);
     }
 
     // return a composed node from one of two child nodes.
@@ -35,15 +40,73 @@ namespace onek {
         using A = ast<F>;
         using N = ast_node<F>;
         auto f = [](B *left, B *right, A &a, S &s, N *ast_parent, bool expectFlag) -> bool {
-            if (left->parse(a, s, ast_parent, false))
+            bool matched;
+            {
+                typename A::choice_point const choice(a);
+                matched = left->parse(a, s, ast_parent, false);
+            }
+            if (matched)
                 return true;
+            else if (s.is_aborted())
+                return false;
             else
                 return right->parse(a, s, ast_parent, expectFlag);
         };
         auto h = arena_handle(left);
-        return make_arena_ptr<C>(h, f, left.get(), right.get());
+        return make_arena_ptr<C>(h, f, left.get(), right.get(), combinator::alternative);
     }
 
+    // sequence with a PEG style cut between left and right: once left has
+    // matched we are committed to this alternative. If right does not match,
+    // the error is reported at the cut and enclosing alternatives and
+    // repetitions are not tried anymore, i.e. the whole parse fails.
+    // Constrained, because > is a comparison that argument dependent lookup
+    // would offer for any type of onek.
+    template<parser_ptr L, parser_ptr R>
+    auto operator>(L left, R right) {
+        using F = typename L::element_type::configuration;
+        using B = parser_base<F>;
+        using C = composed_parser<F>;
+        using S = scan_state;
+        using A = ast<F>;
+        using N = ast_node<F>;
+        auto f = [](B *left, B *right, A &a, S &s, N *ast_parent, bool expectFlag) -> bool {
+            if (!left->parse(a, s, ast_parent, expectFlag))
+                return false;
+            s.cut_point_ = s.p_;
+            if (right->parse(a, s, ast_parent, true))
+                return true;
+            detail::cut_failure(s);
+            return false;
+        };
+        auto h = arena_handle(left);
+        return make_arena_ptr<C>(h, f, left.get(), right.get(), combinator::cut);
+    }
+
+    // separated list: item (separator item)*, optionally followed by one more
+    // separator. The items are added to the enclosing action parent in a flat
+    // run; separators built with token_id::delimiter do not show up in the ast.
+    template<typename L, typename R>
+    auto separated(L item, R separator, bool trailing = false) {
+        using F = typename L::element_type::configuration;
+        using B = parser_base<F>;
+        using C = composed_parser<F>;
+        using S = scan_state;
+        using A = ast<F>;
+        using N = ast_node<F>;
+        auto f = [trailing](B *item, B *separator, A &a, S &s, N *ast_parent, bool expectFlag) -> bool {
+            return detail::parse_list(
+                    a, s, ast_parent, expectFlag, trailing,
+                    [&](bool reportErrors) { return item->parse(a, s, ast_parent, reportErrors); },
+                    [&](bool reportErrors) { return separator->parse(a, s, ast_parent, reportErrors); });
+        };
+        auto h = arena_handle(item);
+        return make_arena_ptr<C>(h, f, item.get(), separator.get(), trailing ? combinator::trailing_list : combinator::list);
+    }
+
+    template<typename L, typename R>
+    auto operator%(L item, R separator) { return separated(item, separator); }
+
     long const many = 1000000;
 
     template <typename P>
@@ -60,6 +123,22 @@ namespace onek {
         return std::forward<P>(p);
     }
 
+    // marks the action of a production as pure, i.e. its result only depends
+    // on the subtree. Apply after prod, which sets the flags.
+    template <typename P>
+    P&& pure(P && p) {
+        p->flags_ |= FLAG_PURE;
+        return std::forward<P>(p);
+    }
+
+    // declares that texts of this grammar are sequences of independent units,
+    // separated by separator outside of brackets, e.g. ';' or '\n'
+    template <typename P>
+    P&& separate_units(P && p, char separator) {
+        p->unit_separator_ = separator;
+        return std::forward<P>(p);
+    }
+
     template<typename P>
     P clone(P const &p) {
         auto h = arena_handle(p);
@@ -75,13 +154,15 @@ namespace onek {
         return pp;
     }
 
-    template<typename P>
+    // Constrained, otherwise code in namespace onek that dereferences a smart
+    // pointer, e.g. *std::shared_ptr, would get the kleene star.
+    template<parser_ptr P>
     P operator*(P const &p) { return repeat(p, 0, many); }
 
-    template<typename P>
+    template<parser_ptr P>
     P operator-(P const &p) { return repeat(p, 0, 1); }
 
-    template<typename P>
+    template<parser_ptr P>
     P operator+(P const &p) { return repeat(p, 1, many); }
 
 }
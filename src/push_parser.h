@@ -0,0 +1,125 @@
+#pragma once
+
+#include "ast.h"
+#include "bracket_index.h"
+#include "grammar_walk.h"
+#include "parser.h"
+#include <coroutine>
+#include <cassert>
+#include <algorithm>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace onek {
+
+    // Push style parsing for input that arrives in chunks, e.g. from a socket.
+    // The caller feeds chunks as they arrive and the parser coroutine resumes
+    // for each of them. The input is split into units at a separator that is
+    // not inside the brackets the grammar declares, see declared_brackets, and
+    // every unit is parsed as soon as it is complete, while the caller is
+    // still receiving the following ones. Without a
+    // separator the whole input is one unit, parsed by finish().
+    // The finished trees own the text of their unit, see ast::adopt.
+    // scn must be the scan state the grammar was created with.
+    template<typename F>
+    class push_parser {
+        public:
+        using A = ast<F>;
+        using C = composed_parser<F>;
+
+        struct promise_type {
+            std::string_view chunk_;
+            bool end_ = false;
+            std::deque<std::optional<A>> results_;
+
+            push_parser get_return_object() noexcept { return push_parser(std::coroutine_handle<promise_type>::from_promise(*this)); }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            std::suspend_always final_suspend() noexcept { return {}; }
+            void return_void() noexcept {}
+            void unhandled_exception() noexcept { std::terminate(); }
+        };
+
+        private:
+        std::coroutine_handle<promise_type> handle_;
+
+        explicit push_parser(std::coroutine_handle<promise_type> handle) noexcept : handle_(handle) {}
+
+        // gives the coroutine access to its own promise without suspending
+        struct this_promise {
+            promise_type *promise_ = nullptr;
+            bool await_ready() const noexcept { return false; }
+            bool await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+                promise_ = &h.promise();
+                return false;
+            }
+            promise_type &await_resume() const noexcept { return *promise_; }
+        };
+
+        static void parse_unit(C *root, scan_state &scn, std::string &unit, bool reportErrors, promise_type &self) {
+            if (std::all_of(unit.begin(), unit.end(), is_space)) {
+                unit.clear();
+                return;
+            }
+            auto text = std::make_shared<std::string const>(std::move(unit));
+            unit.clear();
+            scn.reset(std::string_view(*text));
+            auto a = root->parse(scn, nullptr, reportErrors);
+            if (a)
+                a->adopt(std::move(text));
+            self.results_.push_back(std::move(a));
+        }
+
+        public:
+        push_parser(push_parser &&other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+        push_parser(push_parser const &) = delete;
+        ~push_parser() {
+            if (handle_)
+                handle_.destroy();
+        }
+
+        static push_parser start(C *root, scan_state &scn, char separator = 0, bool reportErrors = true) {
+            promise_type &self = co_await this_promise{};
+            std::string unit;
+            // the same brackets as detail::split_points for parse_parallel
+            auto const kind = detail::bracket_kinds(declared_brackets<F>(root));
+            int depth = 0;
+            while (!self.end_) {
+                for (char c : std::exchange(self.chunk_, {})) {
+                    if (separator && c == separator && depth <= 0) {
+                        parse_unit(root, scn, unit, reportErrors, self);
+                        continue;
+                    }
+                    if (signed char k = kind[(unsigned char)c])
+                        depth += k > 0 ? 1 : -1;
+                    unit += c;
+                }
+                co_await std::suspend_always{};
+            }
+            parse_unit(root, scn, unit, reportErrors, self);
+        }
+
+        // the chunk is copied, it need not outlive the call
+        void feed(std::string_view chunk) {
+            assert(!handle_.done() && "feed after finish");
+            handle_.promise().chunk_ = chunk;
+            handle_.resume();
+        }
+
+        // end of input, parses what is left
+        void finish() {
+            assert(!handle_.done() && "finish called twice");
+            handle_.promise().end_ = true;
+            handle_.resume();
+        }
+
+        [[nodiscard]] bool done() const noexcept { return handle_.done(); }
+
+        // parsed units in input order, std::nullopt for units that did not parse
+        std::deque<std::optional<A>> &results() noexcept { return handle_.promise().results_; }
+    };
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "arena_ptr.h"
+#include "error_messages.h"
+#include "scan_state.h"
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <ostream>
+
+namespace onek {
+
+    struct resource_limits {
+        uint64_t max_nodes = std::numeric_limits<uint64_t>::max();
+        uint64_t max_ast_bytes = std::numeric_limits<uint64_t>::max();
+        uint64_t max_arena_bytes = std::numeric_limits<uint64_t>::max();
+        size_t max_depth = std::numeric_limits<size_t>::max();// nesting of composed productions
+        uint64_t max_backtracks = std::numeric_limits<uint64_t>::max();
+    };
+
+    struct resource_report {
+        uint64_t nodes = 0;// peak size of the ast store
+        uint64_t ast_bytes = 0;
+        uint64_t arena_bytes = 0;// peak of the watched arena, see arena_handle::reserved_bytes
+        size_t peak_depth = 0;
+        uint64_t backtracks = 0;// composed productions that failed and restored their state
+        char const *exceeded = nullptr;// the limit that stopped the parse, if any
+    };
+
+    inline std::ostream &operator<<(std::ostream &os, resource_report const &r) {
+        os << "nodes: " << r.nodes << ", ast bytes: " << r.ast_bytes << ", arena bytes: " << r.arena_bytes
+           << ", peak depth: " << r.peak_depth << ", backtracks: " << r.backtracks;
+        if (r.exceeded)
+            os << ", exceeded: " << r.exceeded;
+        return os;
+    }
+
+    // Opt-in accounting, enabled by pointing scan_state::resources_ to an
+    // instance. Once a limit is exceeded the parse is aborted with
+    // parse_status::limit_exceeded, the same way as after a failed cut.
+    class resource_guard {
+        resource_limits limits_;
+        resource_report report_;
+        size_t depth_ = 0;
+        detail::arena const *arena_ = nullptr;
+
+        bool exceed(scan_state &scn, char const *limit) noexcept {
+            if (!scn.is_aborted()) {
+                report_.exceeded = limit;
+                scn.status_ = parse_status::limit_exceeded;
+                log::limit_exceeded(limit, scn.line_number_, scn.line_begin_, scn.scanner_end_);
+            }
+            return false;
+        }
+
+        public:
+        explicit resource_guard(resource_limits const &limits = {}) noexcept : limits_(limits) {}
+        // arena is watched while parsing, e.g. the one of the grammar, that also
+        // holds the ast if scan_state::ast_memory_ is its resource. It must outlive the guard.
+        resource_guard(resource_limits const &limits, arena_handle &arena) : limits_(limits), arena_(arena.get()) {
+            report_.arena_bytes = arena_->reserved_.bytes();
+        }
+
+        [[nodiscard]] resource_report const &report() const noexcept { return report_; }
+
+        // for the next parse
+        void reset() noexcept {
+            report_ = {.arena_bytes = arena_ ? arena_->reserved_.bytes() : 0};
+            depth_ = 0;
+        }
+
+        // entering a composed production, leave must be called if this returns true
+        bool enter(scan_state &scn) noexcept {
+            if (arena_)
+                report_.arena_bytes = std::max<uint64_t>(report_.arena_bytes, arena_->reserved_.bytes());
+            if (report_.arena_bytes > limits_.max_arena_bytes)
+                return exceed(scn, "arena bytes");
+            if (depth_ == limits_.max_depth)
+                return exceed(scn, "depth");
+            report_.peak_depth = std::max(report_.peak_depth, ++depth_);
+            return true;
+        }
+        void leave() noexcept { --depth_; }
+
+        // the ast store holds nodes nodes of node_size bytes
+        bool grow(scan_state &scn, uint64_t nodes, size_t node_size) noexcept {
+            report_.nodes = std::max(report_.nodes, nodes);
+            report_.ast_bytes = std::max(report_.ast_bytes, nodes * node_size);
+            if (nodes > limits_.max_nodes)
+                return exceed(scn, "nodes");
+            if (nodes * node_size > limits_.max_ast_bytes)
+                return exceed(scn, "ast bytes");
+            return true;
+        }
+
+        bool backtrack(scan_state &scn) noexcept {
+            if (++report_.backtracks > limits_.max_backtracks)
+                return exceed(scn, "backtracks");
+            return true;
+        }
+    };
+}
@@ -1,23 +1,76 @@
 #pragma once
 
+#include "status_saver_template.h"
+#include "token.h"
 #include <string>
 #include <cstring>
+#include <memory_resource>
 
 namespace onek {
 
+    class parse_profiler;
+    class intern_table;
+    class resource_guard;
+    class parse_budget;
+    class bracket_index;
+
+    enum class parse_status : unsigned short {
+        ok,
+        cut_failure,// a production failed after a cut, backtracking is not allowed anymore
+        limit_exceeded,// see resource_limits.h
+        budget_exceeded,// see parse_budget.h
+        cancelled,
+        unbalanced// the brackets of the text do not pair up, see bracket_index.h
+    };
+
+    // the whitespace between tokens, the same for all scanners
+    inline bool is_space(char c) noexcept { return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\a'; }
+
     using scan_ptr = char const *;
     struct scan_state {
         scan_ptr p_;
-        scan_ptr scanner_end_;
+        scan_ptr scanner_end_;// moves to the closing bracket inside a bracket pair, see bracket_index.h
+        scan_ptr text_end_ = scanner_end_;
         scan_ptr line_begin_ = p_;
         size_t line_number_ = 1;// only needed for error reporting
+        parse_profiler *profiler_ = nullptr;// opt-in, see parse_profiler.h
+        resource_guard *resources_ = nullptr;// opt-in, see resource_limits.h
+        parse_budget *budget_ = nullptr;// opt-in, see parse_budget.h
+        std::pmr::memory_resource *ast_memory_ = nullptr;// where the ast nodes go, e.g. arena_handle::resource()
+        parse_status status_ = parse_status::ok;
+        scan_ptr cut_point_ = nullptr;// position of the last cut that was passed
+        token_value value_;// set by scanners that convert while matching, see scanners.h
+        intern_table *symbols_ = nullptr;// if set, identifiers are interned while matching
+        token_array const *tokens_ = nullptr;// if set, terminals match lexemes instead of text, see lexer.h
+        size_t token_pos_ = 0;// next lexeme in tokens_
+        bracket_index const *brackets_ = nullptr;// opt-in, see bracket_index.h
 
         explicit scan_state(std::string_view text)
             : p_{text.begin()}, scanner_end_{text.end()} {
         }
 
-        [[nodiscard]] bool is_end() const noexcept { return *p_ == 0 || p_ == scanner_end_; }
-        [[nodiscard]] bool is_whitespace() const noexcept { return !is_end() && (*p_ == ' ' || *p_ == '\t' || *p_ == '\t'); }
+        // start over with another text, the attached profiler, resource guard, budget, symbols and ast memory are kept.
+        // A bracket index belongs to one text, so it is dropped like the lexemes.
+        void reset(std::string_view text) noexcept {
+            p_ = text.begin();
+            scanner_end_ = text.end();
+            text_end_ = scanner_end_;
+            line_begin_ = p_;
+            line_number_ = 1;
+            status_ = parse_status::ok;
+            cut_point_ = nullptr;
+            value_ = {};
+            tokens_ = nullptr;
+            token_pos_ = 0;
+            brackets_ = nullptr;
+        }
+
+        [[nodiscard]] bool is_end() const noexcept {
+            if (tokens_)
+                return token_pos_ == tokens_->lexemes.size();
+            return p_ == text_end_ || *p_ == 0;
+        }
+        [[nodiscard]] bool is_whitespace() const noexcept { return !is_end() && is_space(*p_); }
         void advance(size_t size) {
             p_ += size;
             while (is_whitespace()) {
@@ -28,13 +81,72 @@ namespace onek {
                 ++p_;
             }
         }
+
+        // once aborted, failures may not be recovered by trying alternatives
+        [[nodiscard]] bool is_aborted() const noexcept { return status_ != parse_status::ok; }
+
+        [[nodiscard]] lexeme const *peek_token() const noexcept {
+            return token_pos_ < tokens_->lexemes.size() ? &tokens_->lexemes[token_pos_] : nullptr;
+        }
+
+        // consumes the next lexeme, p_ follows so that error reporting still works
+        std::string_view take_token() noexcept {
+            auto const &l = tokens_->lexemes[token_pos_++];
+            auto text = tokens_->text_of(l);
+            value_ = l.value;
+            p_ = text.data() + text.size();
+            return text;
+        }
+
         bool match_delimiter(char const *delimiter) {
+            if (tokens_) {
+                auto const *l = peek_token();
+                if (l && tokens_->text_of(*l) == delimiter) {
+                    take_token();
+                    return true;
+                }
+                return false;
+            }
 
-            if (p_ != nullptr && !is_end() && !strcmp(delimiter, p_)) {
-                advance(strlen(delimiter));
+            // bounded by scanner_end_, the text need not be null terminated
+            auto const p = p_;
+            auto const line_begin = line_begin_;
+            auto const line_number = line_number_;
+            advance(0);
+            size_t const n = strlen(delimiter);
+            if (n && size_t(scanner_end_ - p_) >= n && !memcmp(p_, delimiter, n)) {
+                advance(n);
                 return true;
             }
+            p_ = p;
+            line_begin_ = line_begin;
+            line_number_ = line_number;
             return false;
         }
     };
+
+    // Only the scanning position and its end, which moves while bracket
+    // pairs are matched, are saved. In token mode backtracking is an index
+    // reset. The parse status must survive backtracking, otherwise a cut
+    // failure would be forgotten by the enclosing productions.
+    template<>
+    class status_saver<scan_state> {
+        scan_ptr p_;
+        scan_ptr scanner_end_;
+        scan_ptr line_begin_;
+        size_t line_number_;
+        size_t token_pos_;
+
+        public:
+        explicit status_saver(scan_state const &scn) noexcept
+            : p_(scn.p_), scanner_end_(scn.scanner_end_), line_begin_(scn.line_begin_), line_number_(scn.line_number_), token_pos_(scn.token_pos_) {
+        }
+        void restore_to(scan_state &scn) const noexcept {
+            scn.p_ = p_;
+            scn.scanner_end_ = scanner_end_;
+            scn.token_pos_ = token_pos_;
+            scn.line_begin_ = line_begin_;
+            scn.line_number_ = line_number_;
+        }
+    };
 }
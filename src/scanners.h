@@ -0,0 +1,83 @@
+#pragma once
+
+#include "scan_state.h"
+#include "token.h"
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <limits>
+#include <string_view>
+
+namespace onek {
+
+    enum class number_format : unsigned short {
+        integer,// 123
+        floating,// 1.5, .5, 1e3 but not 1
+        hex// 0x1f
+    };
+
+    // Hand written scanner for numbers that validates and converts in one pass
+    // with std::from_chars. The converted value is left in scn.value_, from where
+    // terminal_parser moves it into the ast node. A sign is only accepted if
+    // allow_sign is set. Nothing is read beyond scn.scanner_end_.
+    inline std::string_view scan_number(scan_state &scn, number_format format, bool allow_sign) {
+        char const *backup = scn.p_;
+        while (scn.p_ < scn.scanner_end_ && is_space(*scn.p_))
+            ++(scn.p_);
+
+        char const *start = scn.p_;
+        char const *end = scn.scanner_end_;
+        char const *digits = start;
+        bool negative = false;
+        if (allow_sign && digits < end && (*digits == '-' || *digits == '+')) {
+            negative = *digits == '-';
+            ++digits;
+        }
+
+        auto is_digit = [](char c) { return c >= '0' && c <= '9'; };
+        std::from_chars_result r{nullptr, std::errc::invalid_argument};
+        // the digits are scanned unsigned, so that the most negative long fits
+        auto set_integer = [&](unsigned long magnitude) {
+            if (r.ec != std::errc{})
+                return;
+            if (magnitude > static_cast<unsigned long>(std::numeric_limits<long>::max()) + negative)
+                r.ec = std::errc::result_out_of_range;
+            else
+                scn.value_ = negative ? static_cast<long>(0UL - magnitude) : static_cast<long>(magnitude);
+        };
+        switch (format) {
+            case number_format::integer: {
+                unsigned long magnitude = 0;
+                if (digits < end && is_digit(*digits))
+                    r = std::from_chars(digits, end, magnitude);
+                set_integer(magnitude);
+                break;
+            }
+            case number_format::hex: {
+                unsigned long magnitude = 0;
+                if (end - digits > 2 && digits[0] == '0' && (digits[1] == 'x' || digits[1] == 'X') && isxdigit(static_cast<unsigned char>(digits[2])))
+                    r = std::from_chars(digits + 2, end, magnitude, 16);
+                set_integer(magnitude);
+                break;
+            }
+            case number_format::floating: {
+                double value = 0;
+                if (digits < end && (is_digit(*digits) || *digits == '.'))
+                    r = std::from_chars(digits, end, value, std::chars_format::general);
+                // integers are left to the integer scanner
+                if (r.ec == std::errc{} && std::string_view(digits, r.ptr).find_first_of(".eE") == std::string_view::npos)
+                    r.ec = std::errc::invalid_argument;
+                if (r.ec == std::errc{})
+                    scn.value_ = negative ? -value : value;
+                break;
+            }
+        }
+
+        if (r.ec != std::errc{}) {
+            scn.p_ = backup;
+            return {};
+        }
+        scn.p_ = r.ptr;
+        return {start, r.ptr};
+    }
+}
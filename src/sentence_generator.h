@@ -0,0 +1,236 @@
+#pragma once
+
+#include "frozen_grammar.h"
+#include "grammar_optimizer.h"
+#include "parse_events.h"
+#include "scan_state.h"
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <random>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace onek {
+
+    struct generator_options {
+        uint64_t seed = 0;
+        size_t target_size = 80;// bytes of a sentence, optional parts are generated until it is reached
+        size_t max_depth = 16;  // deeper than this the shortest alternatives are chosen
+        double repeat = 0.5;    // probability of one more repetition
+        std::unordered_map<std::string_view, double> weights{};// of alternatives by production name, 1 if not given
+        // text of a terminal that does not match literals, e.g. a number, the default
+        // knows the tokens of token.h. Candidates the terminal does not accept are dropped.
+        std::function<std::string(token_id, std::mt19937_64 &)> sample{};
+        size_t attempts = 100;// sentences tried before giving up, see sentence
+    };
+
+    // Generates random sentences of a grammar, e.g. inputs of a given size for
+    // benchmarks. The grammar is frozen and optimized, so that each alternative
+    // of a production has the same chance unless weighted otherwise. Every
+    // sentence is checked by parsing it, because ordered choice may not accept
+    // all that the productions describe. Terminals are matched with scn, the
+    // scan state the grammar was built with. While a sentence is generated it
+    // scans private texts without symbols, profiler or limits, afterwards it
+    // is restored.
+    template<typename F>
+    class sentence_generator {
+        using B = parser_base<F>;
+        using C = composed_parser<F>;
+        using T = terminal_parser<F>;
+        static constexpr size_t infinite = std::numeric_limits<size_t>::max() / 4;
+
+        frozen_grammar<F> grammar_;
+        scan_state &scn_;
+        generator_options options_;
+        std::mt19937_64 random_;
+        std::vector<size_t> shortest_;// length in tokens of the shortest expansion of each record
+        std::string out_;
+
+        static size_t times(size_t cost, size_t n) { return std::min(infinite, cost * n); }
+
+        void compute_shortest() {
+            auto nodes = grammar_.nodes();
+            shortest_.assign(nodes.size(), infinite);
+            for (bool changed = true; changed;) {
+                changed = false;
+                for (size_t i = 0; i < nodes.size(); ++i) {
+                    auto const &n = nodes[i];
+                    size_t cost = 1;
+                    auto children = n.kind == frozen_kind::literals || n.kind == frozen_kind::delegate ? std::span<uint32_t const>{} : grammar_.children(n);
+                    switch (n.kind) {
+                        case frozen_kind::sequence:
+                        case frozen_kind::cut:
+                            cost = 0;
+                            for (uint32_t c : children)
+                                cost = std::min(infinite, cost + shortest_[c]);
+                            break;
+                        case frozen_kind::alternative:
+                            cost = infinite;
+                            for (uint32_t c : children)
+                                cost = std::min(cost, shortest_[c]);
+                            break;
+                        case frozen_kind::list:
+                        case frozen_kind::trailing_list:
+                            cost = shortest_[children[0]];
+                            break;
+                        default:
+                            break;
+                    }
+                    cost = times(cost, n.min_repeat);
+                    if (cost < shortest_[i]) {
+                        shortest_[i] = cost;
+                        changed = true;
+                    }
+                }
+            }
+        }
+
+        static std::string default_sample(token_id id, std::mt19937_64 &random) {
+            auto pick = [&](std::string_view chars, size_t n) {
+                std::string s;
+                for (size_t k = 0; k < n; ++k)
+                    s += chars[random() % chars.size()];
+                return s;
+            };
+            switch (id) {
+                case token_id::int_number:
+                    return random() % 4 ? pick("123456789", 1) + pick("0123456789", random() % 4) : "0x" + pick("0123456789abcdef", 1 + random() % 4);
+                case token_id::float_number:
+                    return pick("123456789", 1) + "." + pick("0123456789", 1 + random() % 3);
+                case token_id::ident:
+                    return pick("ABCDEFGHIJKLMNOPQRSTUVWXYZ", 1) + pick("ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_", 1 + random() % 5);
+                default:
+                    return pick("abcdefghijklmnopqrstuvwxyz", 1 + random() % 5);
+            }
+        }
+
+        void emit(std::string_view token) {
+            if (token.empty())
+                return;
+            if (!out_.empty())
+                out_ += ' ';
+            out_ += token;
+        }
+
+        // a text the terminal accepts completely. Samples are cheap and often
+        // only one kind fits, e.g. hex numbers, so many are tried.
+        bool emit_terminal(T const *t) {
+            for (int k = 0; k < 64; ++k) {
+                std::string candidate = t->token_id_ == token_id::the_end ? std::string{} : options_.sample ? options_.sample(t->token_id_, random_) : default_sample(t->token_id_, random_);
+                scn_.reset(candidate);
+                if (!t->match_().empty() && scn_.p_ == scn_.scanner_end_) {
+                    emit(candidate);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        bool short_mode(size_t depth) const noexcept { return depth > options_.max_depth || out_.size() >= options_.target_size; }
+
+        size_t repetitions(frozen_node const &n, size_t depth) {
+            size_t count = n.min_repeat;
+            auto more = std::bernoulli_distribution(options_.repeat);
+            while (count < n.max_repeat && !short_mode(depth) && more(random_))
+                ++count;
+            return std::max<size_t>(count, 1);
+        }
+
+        uint32_t choose(std::span<uint32_t const> children, size_t depth) {
+            auto nodes = grammar_.nodes();
+            auto shortest = [&]() { return *std::min_element(children.begin(), children.end(), [&](uint32_t x, uint32_t y) { return shortest_[x] < shortest_[y]; }); };
+            if (short_mode(depth))
+                return shortest();
+            std::vector<double> weights;
+            for (uint32_t c : children) {
+                auto it = options_.weights.find(is_named_production(nodes[c].name) ? nodes[c].name : "");
+                weights.push_back(shortest_[c] >= infinite ? 0 : it == options_.weights.end() ? 1 : it->second);
+            }
+            if (std::all_of(weights.begin(), weights.end(), [](double w) { return w <= 0; }))
+                return shortest();
+            return children[std::discrete_distribution<size_t>(weights.begin(), weights.end())(random_)];
+        }
+
+        bool generate(uint32_t index, size_t depth) {
+            auto const &n = grammar_.nodes()[index];
+            // optional parts make sentences grow, so they are there until the target size is reached
+            if (n.min_repeat == 0 && short_mode(depth))
+                return true;
+            size_t const count = repetitions(n, depth);
+            for (size_t r = 0; r < count; ++r) {
+                if (r && n.delim)
+                    emit(n.delim);
+                if (!generate_once(n, depth))
+                    return false;
+            }
+            return true;
+        }
+
+        bool generate_once(frozen_node const &n, size_t depth) {
+            switch (n.kind) {
+                case frozen_kind::literals: {
+                    auto l = grammar_.literals(n);
+                    emit(l[random_() % l.size()]);
+                    return true;
+                }
+                case frozen_kind::delegate: {
+                    auto const *b = grammar_.origin(n);
+                    return b->isComposed() || emit_terminal(static_cast<T const *>(b));// custom combinators are not generated
+                }
+                case frozen_kind::sequence:
+                case frozen_kind::cut:
+                    for (uint32_t c : grammar_.children(n))
+                        if (!generate(c, depth + 1))
+                            return false;
+                    return true;
+                case frozen_kind::alternative:
+                    return generate(choose(grammar_.children(n), depth), depth + 1);
+                case frozen_kind::list:
+                case frozen_kind::trailing_list: {
+                    auto c = grammar_.children(n);
+                    if (!generate(c[0], depth + 1))
+                        return false;
+                    auto more = std::bernoulli_distribution(options_.repeat);
+                    while (!short_mode(depth) && more(random_))
+                        if (!generate(c[1], depth + 1) || !generate(c[0], depth + 1))
+                            return false;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        public:
+        // root must be wired, see wire_placeholders
+        sentence_generator(C *root, scan_state &scn, generator_options options = {})
+            : grammar_(root), scn_(scn), options_(std::move(options)), random_(options_.seed) {
+            optimize(grammar_);
+            compute_shortest();
+        }
+
+        // a random sentence the grammar accepts, nullopt if none was found in options.attempts tries
+        std::optional<std::string> sentence() {
+            struct restore_on_exit {
+                scan_state &scn;
+                scan_state const saved;
+                ~restore_on_exit() { scn = saved; }
+            } const restore{scn_, scn_};
+            scn_ = scan_state(std::string_view{});
+            for (size_t k = 0; k < options_.attempts; ++k) {
+                out_.clear();
+                if (!generate(0, 0))
+                    continue;
+                scn_.reset(out_);
+                if (grammar_.recognize(scn_, false))
+                    return out_;
+            }
+            return std::nullopt;
+        }
+    };
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "token.h"
+#include <deque>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace onek {
+
+    // Assigns dense ids to identifiers. Attached to a parse by pointing
+    // scan_state::symbols_ to it, ident tokens then carry their symbol_id
+    // in ast_node::value_. Ids stay valid for the lifetime of the table, so
+    // a table can be shared by many parses.
+    class intern_table {
+        std::deque<std::string> names_;// a deque does not move its elements, the keys below point into it
+        std::unordered_map<std::string_view, symbol_id> ids_;
+
+        public:
+        symbol_id intern(std::string_view name) {
+            auto it = ids_.find(name);
+            if (it != ids_.end())
+                return it->second;
+            auto id = symbol_id(names_.size());
+            ids_.emplace(names_.emplace_back(name), id);
+            return id;
+        }
+
+        [[nodiscard]] std::optional<symbol_id> find(std::string_view name) const {
+            auto it = ids_.find(name);
+            if (it == ids_.end())
+                return std::nullopt;
+            return it->second;
+        }
+
+        [[nodiscard]] std::string_view name(symbol_id id) const { return names_[size_t(id)]; }
+        [[nodiscard]] size_t size() const noexcept { return names_.size(); }
+    };
+
+    // intern table with one slot per symbol, e.g. the values of variables.
+    // Looking up a variable in an action is then an array index.
+    template<typename V>
+    class symbol_table : public intern_table {
+        std::vector<V> slots_;
+
+        public:
+        V &operator[](symbol_id id) {
+            auto i = size_t(id);
+            if (i >= slots_.size())
+                slots_.resize(size());
+            return slots_[i];
+        }
+
+        symbol_id set(std::string_view name, V value) {
+            auto id = intern(name);
+            (*this)[id] = std::move(value);
+            return id;
+        }
+    };
+}
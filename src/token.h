@@ -1,6 +1,11 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <cstdint>
+#include <string_view>
+#include <variant>
+#include <vector>
 
 namespace onek {
 
@@ -26,6 +31,8 @@ namespace onek {
     constexpr unsigned short FLAG_INFIX = 64;
     constexpr unsigned short FLAG_POSTFIX = 128;
     constexpr unsigned short FLAG_PLACEHOLDER = 256;
+    constexpr unsigned short FLAG_SIGNED = 512;// numeric terminals accept a leading sign
+    constexpr unsigned short FLAG_PURE = 1024;// the action only depends on the subtree, see hash_cons.h
 
     const char *token_to_string(token_id id) noexcept {
         switch (id) {
@@ -45,4 +52,35 @@ namespace onek {
     }
 
     using FilterType = std::array<const char *, 5>;// todo
+
+    // dense id of an interned identifier, see symbol_table.h
+    enum class symbol_id : std::uint32_t {};
+
+    // value converted by the scanner while matching a token, so that actions
+    // do not have to parse the token string again
+    using token_value = std::variant<std::monostate, long, double, symbol_id>;
+
+    // one token of a lexed text, see lexer.h
+    struct lexeme {
+        token_id token;
+        std::uint32_t offset;// from the begin of the lexed text
+        std::uint32_t length;
+        token_value value;
+        std::uint64_t scanners = 0;// bit i is set if token_array::scanners[i] matches the whole lexeme
+    };
+
+    struct token_array {
+        std::string_view text;
+        std::vector<lexeme> lexemes;
+        std::vector<void const *> scanners;// the terminals that are not literals, at most 64
+
+        [[nodiscard]] std::string_view text_of(lexeme const &l) const noexcept { return text.substr(l.offset, l.length); }
+
+        // whether the terminal scanner matches the whole lexeme, tokens of one id may
+        // come from different scanners, e.g. decimal and hex numbers
+        [[nodiscard]] bool scanned_by(lexeme const &l, void const *scanner) const noexcept {
+            auto it = std::find(scanners.begin(), scanners.end(), scanner);
+            return it != scanners.end() && (l.scanners >> (it - scanners.begin()) & 1);
+        }
+    };
 }
@@ -1,4 +1,8 @@
 #include "onek/onek-parser.h"
+#include <future>
+#include <numeric>
+#include <sstream>
+#include <unistd.h>
 #include <string_view>
 #include <variant>
 
@@ -16,6 +20,9 @@ namespace example {
     using T = onek::terminal_parser<F>;
     using N = onek::ast_node<F>;
 
+    // values of the variables used in the expressions
+    inline onek::symbol_table<long> variables;
+
     struct my_parser_configuration {
         using V = std::variant<long, char, double>;
 
@@ -23,8 +30,9 @@ namespace example {
             if (node.isTerminal()) {
                 switch (node.token_id_) {
                     case onek::token_id::func: return {node.tokenstr.front()};
-                    case onek::token_id::int_number: return {atol(node.tokenstr.begin())};
-                    case onek::token_id::float_number: return {atof(node.tokenstr.begin())};
+                    case onek::token_id::int_number: return {std::get<long>(node.value_)};
+                    case onek::token_id::float_number: return {std::get<double>(node.value_)};
+                    case onek::token_id::ident: return {variables[std::get<onek::symbol_id>(node.value_)]};
                     default: break;
                 }
                 assert(false);
@@ -61,7 +69,10 @@ namespace example {
         return {lambda_(c0_value, c1_value)};
     }
 
+    inline long arithmetic_op_calls = 0;
+
     F::V arithmetic_op_action(N const &node) noexcept {
+        ++arithmetic_op_calls;
         N *left = node.first_child_;
         long left_value = std::get<long>(left->action());
         long sum = left_value;
@@ -89,13 +100,14 @@ namespace example {
         return {sum};
     }
 
-    onek::arena_ptr<C> grammar(onek::scan_state &scn) {
-        auto handle = onek::arena_handle();
+    onek::arena_ptr<C> grammar(onek::scan_state &scn, onek::arena_backend backend = onek::arena_backend::heap) {
+        auto handle = onek::arena_handle(backend);
 
         // shortcuts for creating terminals
         auto the_end = [&scn, &handle]() { return onek::make_arena_ptr<T>(handle, onek::token_id::the_end, [&scn]() -> std::string_view { return scn.is_end() ? "of the story" : std::string_view{}; }); };
-        auto int_number = [&scn, &handle]() { return onek::make_arena_ptr<T>(handle, onek::token_id::int_number, scn, "^[-]{0,1}[0-9]+"); };
-        auto float_number = [&scn, &handle]() { return onek::make_arena_ptr<T>(handle, onek::token_id::float_number, scn, "^[-]{0,1}[0-9]*[.][0-9]+"); };
+        auto int_number = [&scn, &handle]() { return onek::make_arena_ptr<T>(handle, onek::token_id::int_number, scn, onek::number_format::integer, onek::FLAG_SIGNED); };
+        auto hex_number = [&scn, &handle]() { return onek::make_arena_ptr<T>(handle, onek::token_id::int_number, scn, onek::number_format::hex); };
+        auto float_number = [&scn, &handle]() { return onek::make_arena_ptr<T>(handle, onek::token_id::float_number, scn, onek::number_format::floating, onek::FLAG_SIGNED); };
         auto ident = [&scn, &handle]() { return onek::make_arena_ptr<T>(handle, onek::token_id::ident, scn, "^[A-Z][A-Z0-9_-]+"); };
         auto open = [&scn, &handle]<typename... F>(F... f) { return onek::make_arena_ptr<T>(handle, onek::token_id::open, scn, onek::FilterType{f...}); };
         auto close = [&scn, &handle]<typename... F>(F... f) { return onek::make_arena_ptr<T>(handle, onek::token_id::close, scn, onek::FilterType{f...}); };
@@ -116,10 +128,10 @@ namespace example {
         // rewire_placeholders below is 'true'
 
         // clang-format off
-        auto sub_expression =   prod( open("(") >> p("expression") >> close(")")      , "sub");
-        auto factor =           prod( int_number() | sub_expression                   , "unsigned factor");
-        auto term =             prod( factor >> *(infix_op("*", "/") >> f("term"))    , arithmetic_op_action, "term");
-        auto expression =       prod( term >> *(infix_op("+", "-") >> f("expression")), arithmetic_op_action, "expression");
+        auto sub_expression =   prod( open("(") > p("expression") >> close(")")       , "sub");
+        auto factor =           prod( hex_number() | int_number() | ident() | sub_expression, "unsigned factor");
+        auto term =        pure(prod( factor >> *(infix_op("*", "/") >> f("term"))    , arithmetic_op_action, "term"));
+        auto expression =  pure(prod( term >> *(infix_op("+", "-") >> f("expression")), arithmetic_op_action, "expression"));
         auto program =          prod( expression >> the_end()                         , "program");
         // clang-format on
 
@@ -128,6 +140,89 @@ namespace example {
     }
 }
 
+namespace example {
+
+    F::V sum_action(N const &node) noexcept {
+        long sum = 0;
+        for (N const *child = node.first_child_; child; child = child->next_sibbling_)
+            sum += std::get<long>(child->action());
+        return {sum};
+    }
+
+    // comma separated list of numbers
+    onek::arena_ptr<C> list_grammar(onek::scan_state &scn, bool trailing) {
+        auto handle = onek::arena_handle();
+        auto the_end = [&scn, &handle]() { return onek::make_arena_ptr<T>(handle, onek::token_id::the_end, [&scn]() -> std::string_view { return scn.is_end() ? "of the story" : std::string_view{}; }); };
+        auto int_number = [&scn, &handle]() { return onek::make_arena_ptr<T>(handle, onek::token_id::int_number, scn, onek::number_format::integer, onek::FLAG_SIGNED); };
+        auto comma = [&scn, &handle]() { return onek::make_arena_ptr<T>(handle, onek::token_id::delimiter, scn, onek::FilterType{","}); };
+
+        // clang-format off
+        auto numbers =          prod( separated(int_number(), comma(), trailing)      , sum_action, "sum");
+        auto program =          prod( numbers >> the_end()                            , "program");
+        // clang-format on
+
+        onek::wire_placeholders<F>(program.get(), true);
+        return program;
+    }
+
+    F::V last_child_action(N const &node) noexcept { return node.last_child_->action(); }
+
+    // sums and products of calls f(1) or f[1], with alternatives to optimize
+    onek::arena_ptr<C> call_grammar(onek::scan_state &scn) {
+        auto handle = onek::arena_handle();
+        auto the_end = [&scn, &handle]() { return onek::make_arena_ptr<T>(handle, onek::token_id::the_end, [&scn]() -> std::string_view { return scn.is_end() ? "of the story" : std::string_view{}; }); };
+        auto int_number = [&scn, &handle]() { return onek::make_arena_ptr<T>(handle, onek::token_id::int_number, scn, onek::number_format::integer); };
+        auto literal = [&scn, &handle](onek::token_id id, char const *l) { return onek::make_arena_ptr<T>(handle, id, scn, onek::FilterType{l}); };
+        auto name = [&]() { return literal(onek::token_id::func, "f"); };
+        auto op = [&](char const *l) { return literal(onek::token_id::func, l); };
+
+        // clang-format off
+        auto call =             prod( (name() >> literal(onek::token_id::open, "(") >> int_number() >> literal(onek::token_id::close, ")"))
+                                    | (name() >> literal(onek::token_id::open, "[") >> int_number() >> literal(onek::token_id::close, "]"))
+                                    | int_number()                                    , last_child_action, "call");
+        auto sum =              prod( call >> *((op("+") | op("-") | op("*")) >> call), arithmetic_op_action, "sum");
+        auto program =          prod( sum >> the_end()                                , "program");
+        // clang-format on
+
+        onek::wire_placeholders<F>(program.get(), true);
+        return program;
+    }
+
+    // a hex number and a decimal one, both are int_number tokens
+    onek::arena_ptr<C> hex_grammar(onek::scan_state &scn) {
+        auto handle = onek::arena_handle();
+        auto the_end = [&scn, &handle]() { return onek::make_arena_ptr<T>(handle, onek::token_id::the_end, [&scn]() -> std::string_view { return scn.is_end() ? "of the story" : std::string_view{}; }); };
+        auto int_number = [&scn, &handle]() { return onek::make_arena_ptr<T>(handle, onek::token_id::int_number, scn, onek::number_format::integer); };
+        auto hex_number = [&scn, &handle]() { return onek::make_arena_ptr<T>(handle, onek::token_id::int_number, scn, onek::number_format::hex); };
+
+        // clang-format off
+        auto numbers =          prod( hex_number() >> int_number()                    , sum_action, "sum");
+        auto program =          prod( numbers >> the_end()                            , "program");
+        // clang-format on
+
+        onek::wire_placeholders<F>(program.get(), true);
+        return program;
+    }
+
+    // "1" is first matched as part of the optional pair, which then fails.
+    // If repeated, the last number is matched as part of a pair that fails.
+    onek::arena_ptr<C> optional_grammar(onek::scan_state &scn, bool repeated = false) {
+        auto handle = onek::arena_handle();
+        auto the_end = [&scn, &handle]() { return onek::make_arena_ptr<T>(handle, onek::token_id::the_end, [&scn]() -> std::string_view { return scn.is_end() ? "of the story" : std::string_view{}; }); };
+        auto int_number = [&scn, &handle]() { return onek::make_arena_ptr<T>(handle, onek::token_id::int_number, scn, onek::number_format::integer); };
+        auto plus = [&scn, &handle]() { return onek::make_arena_ptr<T>(handle, onek::token_id::func, scn, onek::FilterType{"+"}); };
+
+        // clang-format off
+        auto pair =             prod( int_number() >> plus()                          , "pair");
+        auto pairs =            repeated ? *pair : -pair;
+        auto program =          prod( pairs >> int_number() >> the_end()              , sum_action, "program");
+        // clang-format on
+
+        onek::wire_placeholders<F>(program.get(), true);
+        return program;
+    }
+}
+
 void test_expression(std::string_view text, long right_result, char const *ast_graph) {
 
     auto print_variant_type = [](auto &&value) {
@@ -136,6 +231,7 @@ void test_expression(std::string_view text, long right_result, char const *ast_g
     };
 
     auto scn = onek::scan_state(text);
+    scn.symbols_ = &example::variables;
     auto program = example::grammar(scn);
     auto ast = program->parse(scn, nullptr, true);
     {
@@ -168,5 +264,936 @@ BOOST_AUTO_TEST_CASE(parenthesis5)          { test_expression("(1 + 2) * 3", 9,
 BOOST_AUTO_TEST_CASE(parenthesis6)          { test_expression("2 * (3 + 4)", 14, "ast6.gv"); }
 BOOST_AUTO_TEST_CASE(associativity7)        { test_expression("1 - 2 + 3", 2, "ast7.gv"); }
 BOOST_AUTO_TEST_CASE(negative_number8)      { test_expression("(1 - -2) * 3", 9, "ast8.gv"); }
+BOOST_AUTO_TEST_CASE(hex_number9)           { test_expression("0x1F + 0XA * 2", 51, "ast9.gv"); }
+BOOST_AUTO_TEST_CASE(variables10)           { example::variables.set("ALPHA", 3); example::variables.set("BETA", 4);
+                                              test_expression("ALPHA * BETA - (ALPHA + 1)", 8, "ast10.gv"); }
+BOOST_AUTO_TEST_SUITE_END();
+// clang-format on
+
+void test_export(std::string_view text, onek::export_limits limits, uint64_t expected_nodes, bool expected_truncation) {
+    auto scn = onek::scan_state(text);
+    auto program = example::grammar(scn);
+    auto ast = program->parse(scn, nullptr, true);
+    BOOST_REQUIRE_MESSAGE(ast, std::string(text) + " did not compile");
+
+    std::stringstream dot, json;
+    auto dot_result = ast->write_graphviz(dot, limits);
+    auto json_result = ast->write_json(json, limits);
+    BOOST_CHECK_EQUAL(dot_result.nodes, expected_nodes);
+    BOOST_CHECK_EQUAL(json_result.nodes, expected_nodes);
+    BOOST_CHECK_EQUAL(dot_result.truncated, expected_truncation);
+    BOOST_CHECK(json.str().find(expected_truncation ? "\"truncated\":true" : "\"truncated\":false") != std::string::npos);
+}
+
+// more than 65535 nodes, ids must not wrap around
+void test_export_wide_tree() {
+    std::deque<example::N> nodes(70001);
+    for (size_t i = 1; i < nodes.size(); ++i)
+        nodes[0].add_child(&nodes[i]);
+    std::stringstream dot;
+    auto result = onek::write_graphviz(dot, &nodes[0]);
+    BOOST_CHECK_EQUAL(result.nodes, 70001);
+    BOOST_CHECK(dot.str().find("n0 -> n70000\n") != std::string::npos);
+}
+
+// clang-format off
+BOOST_AUTO_TEST_SUITE(ast_export);
+BOOST_AUTO_TEST_CASE(complete_tree)         { test_export("1 + 2 * 3", {}, 10, false); }
+BOOST_AUTO_TEST_CASE(depth_limit)           { test_export("1 + 2 * 3", {.max_depth = 2}, 3, true); }
+BOOST_AUTO_TEST_CASE(node_limit)            { test_export("1 + 2 * 3", {.max_nodes = 3}, 3, true); }
+BOOST_AUTO_TEST_CASE(wide_tree)             { test_export_wide_tree(); }
+BOOST_AUTO_TEST_SUITE_END();
+// clang-format on
+
+void test_profile(std::string_view text) {
+    auto profiler = onek::parse_profiler();
+    auto scn = onek::scan_state(text);
+    scn.profiler_ = &profiler;
+    auto program = example::grammar(scn);
+    auto ast = program->parse(scn, nullptr, true);
+    BOOST_REQUIRE_MESSAGE(ast, std::string(text) + " did not compile");
+
+    for (char const *name : {"program", "expression", "term", "unsigned factor", "sub"}) {
+        auto stats = profiler.find(name);
+        BOOST_REQUIRE_MESSAGE(stats, std::string("no statistics for production ") + name);
+        BOOST_CHECK_EQUAL(stats->attempts, stats->successes + stats->failures);
+        BOOST_CHECK(stats->cumulative_time >= stats->self_time);
+    }
+    BOOST_CHECK_EQUAL(profiler.find("program")->successes, 1);
+    BOOST_CHECK(profiler.find("int_number")->failures > 0);
+
+    std::stringstream table, json;
+    profiler.report(table);
+    profiler.write_json(json);
+    BOOST_CHECK(table.str().find("expression") != std::string::npos);
+    BOOST_CHECK(json.str().find("\"production\":\"term\"") != std::string::npos);
+}
+
+// names are free text, the report must stay valid json
+void test_profile_escaped_name() {
+    auto profiler = onek::parse_profiler();
+    char const text[] = "x";
+    profiler.enter("say \"hi\"\\", text, 0);
+    profiler.leave(true);
+    std::stringstream json;
+    profiler.write_json(json);
+    BOOST_CHECK(json.str().find(R"("production":"say \"hi\"\\",)") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_SUITE(profiling);
+BOOST_AUTO_TEST_CASE(parse_profile)         { test_profile("(1 + 2) * 3 - (4 * (5 - 6))"); }
+BOOST_AUTO_TEST_CASE(escaped_name)          { test_profile_escaped_name(); }
+BOOST_AUTO_TEST_SUITE_END();
+
+void test_cut(std::string_view text, onek::parse_status expected_status, std::string_view cut_point) {
+    auto scn = onek::scan_state(text);
+    auto program = example::grammar(scn);
+    auto ast = program->parse(scn, nullptr, true);
+    BOOST_CHECK_MESSAGE(!ast, std::string(text) + " should not compile");
+    BOOST_CHECK(scn.status_ == expected_status);
+    if (expected_status == onek::parse_status::cut_failure)
+        BOOST_CHECK_EQUAL(std::string_view(scn.cut_point_, scn.scanner_end_), cut_point);
+}
+
+// clang-format off
+BOOST_AUTO_TEST_SUITE(cut);
+BOOST_AUTO_TEST_CASE(no_backtracking)       { test_cut("2 * (1 + ) - 3", onek::parse_status::cut_failure, "1 + ) - 3"); }
+BOOST_AUTO_TEST_CASE(nested)                { test_cut("((1) * (2 3))", onek::parse_status::cut_failure, "2 3))"); }
+BOOST_AUTO_TEST_CASE(without_cut)           { test_cut("1 + 2 3", onek::parse_status::ok, ""); }
+BOOST_AUTO_TEST_SUITE_END();
+// clang-format on
+
+template<typename V>
+void test_scan_number(std::string_view text, onek::number_format format, bool allow_sign, std::string_view token, V value) {
+    auto scn = onek::scan_state(text);
+    auto tokenstr = onek::scan_number(scn, format, allow_sign);
+    BOOST_CHECK_EQUAL(tokenstr, token);
+    if (token.empty()) {
+        BOOST_CHECK(scn.p_ == text.begin());
+        BOOST_CHECK(std::holds_alternative<std::monostate>(scn.value_));
+    } else {
+        BOOST_REQUIRE(std::holds_alternative<V>(scn.value_));
+        BOOST_CHECK_EQUAL(std::get<V>(scn.value_), value);
+    }
+}
+
+// clang-format off
+BOOST_AUTO_TEST_SUITE(number_scanners);
+BOOST_AUTO_TEST_CASE(integer)               { test_scan_number(" 42+1", onek::number_format::integer, false, "42", 42L); }
+BOOST_AUTO_TEST_CASE(signed_integer)        { test_scan_number("-42", onek::number_format::integer, true, "-42", -42L); }
+BOOST_AUTO_TEST_CASE(unsigned_integer)      { test_scan_number("-42", onek::number_format::integer, false, "", 0L); }
+BOOST_AUTO_TEST_CASE(bounded)               { test_scan_number(std::string_view("123", 2), onek::number_format::integer, false, "12", 12L); }
+BOOST_AUTO_TEST_CASE(hex)                   { test_scan_number("-0xfF)", onek::number_format::hex, true, "-0xfF", -255L); }
+BOOST_AUTO_TEST_CASE(not_hex)               { test_scan_number("0x", onek::number_format::hex, false, "", 0L); }
+BOOST_AUTO_TEST_CASE(not_hex_byte)          { test_scan_number("0x\xe9", onek::number_format::hex, false, "", 0L); }
+BOOST_AUTO_TEST_CASE(most_negative)         { test_scan_number("-9223372036854775808", onek::number_format::integer, true, "-9223372036854775808", std::numeric_limits<long>::min()); }
+BOOST_AUTO_TEST_CASE(most_negative_hex)     { test_scan_number("-0x8000000000000000", onek::number_format::hex, true, "-0x8000000000000000", std::numeric_limits<long>::min()); }
+BOOST_AUTO_TEST_CASE(too_large)             { test_scan_number("9223372036854775808", onek::number_format::integer, true, "", 0L); }
+BOOST_AUTO_TEST_CASE(too_negative)          { test_scan_number("-9223372036854775809", onek::number_format::integer, true, "", 0L); }
+BOOST_AUTO_TEST_CASE(floating)              { test_scan_number("+.5e1 ", onek::number_format::floating, true, "+.5e1", 5.0); }
+BOOST_AUTO_TEST_CASE(integer_is_no_float)   { test_scan_number("17", onek::number_format::floating, true, "", 0.0); }
+BOOST_AUTO_TEST_SUITE_END();
+// clang-format on
+
+void test_interning(std::string_view text, size_t distinct) {
+    auto symbols = onek::intern_table();
+    auto scn = onek::scan_state(text);
+    scn.symbols_ = &symbols;
+    auto program = example::grammar(scn);
+    auto ast = program->parse(scn, nullptr, true);
+    BOOST_REQUIRE_MESSAGE(ast, std::string(text) + " did not compile");
+    BOOST_CHECK_EQUAL(symbols.size(), distinct);
+
+    for (auto const &node : ast->memory_) {
+        if (node.token_id_ != onek::token_id::ident)
+            continue;
+        BOOST_REQUIRE(std::holds_alternative<onek::symbol_id>(node.value_));
+        auto id = std::get<onek::symbol_id>(node.value_);
+        BOOST_CHECK_EQUAL(symbols.name(id), node.tokenstr);
+        BOOST_CHECK(symbols.find(node.tokenstr) == id);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(interning);
+BOOST_AUTO_TEST_CASE(dense_ids)             { test_interning("XX * (YY + XX) - ZZ / YY", 3); }
+BOOST_AUTO_TEST_SUITE_END();
+
+void test_batch(std::string_view text, long (*expected)(long alpha, long beta)) {
+    auto symbols = onek::intern_table();
+    auto scn = onek::scan_state(text);
+    scn.symbols_ = &symbols;
+    auto program = example::grammar(scn);
+    auto ast = program->parse(scn, nullptr, true);
+    BOOST_REQUIRE_MESSAGE(ast, std::string(text) + " did not compile");
+
+    // more rows than fit into one block
+    size_t const rows = 5000;
+    std::vector<long> alpha(rows), beta(rows), out(rows);
+    std::iota(alpha.begin(), alpha.end(), -100);
+    std::iota(beta.begin(), beta.end(), 1);
+
+    using E = onek::batch_evaluator<example::F, long>;
+    auto evaluator = E(ast->get_root_node());
+    evaluator.bind(symbols.intern("ALPHA"), alpha);
+    evaluator.bind(symbols.intern("BETA"), beta);
+    evaluator.on("expression", E::infix);
+    evaluator.on("term", E::infix);
+    evaluator.evaluate(out);
+
+    size_t wrong = 0;
+    for (size_t i = 0; i < rows; ++i)
+        wrong += out[i] != expected(alpha[i], beta[i]);
+    BOOST_CHECK_EQUAL(wrong, 0);
+}
+
+// clang-format off
+BOOST_AUTO_TEST_SUITE(batch_evaluation);
+BOOST_AUTO_TEST_CASE(columns)               { test_batch("ALPHA * 2 + BETA - (ALPHA - 1) * 3", [](long a, long b) { return a * 2 + b - (a - 1) * 3; }); }
+BOOST_AUTO_TEST_CASE(constant)              { test_batch("(7 - 0x2) / 5", [](long, long) { return 1L; }); }
+BOOST_AUTO_TEST_CASE(division)              { test_batch("ALPHA / BETA * BETA", [](long a, long b) { return a / b * b; }); }
+BOOST_AUTO_TEST_SUITE_END();
+// clang-format on
+
+// the frozen grammar must build the same ast as the grammar it was frozen from
+void test_frozen(std::string_view text, onek::parse_status expected_status) {
+    auto scn = onek::scan_state(text);
+    scn.symbols_ = &example::variables;
+    auto program = example::grammar(scn);
+    auto frozen = onek::frozen_grammar<example::F>(program.get());
+    BOOST_CHECK_EQUAL(frozen.nodes().front().name, "program");
+
+    auto ast = program->parse(scn, nullptr, false);
+    auto pointer_status = scn.status_;
+    scn = onek::scan_state(text);
+    scn.symbols_ = &example::variables;
+    auto frozen_ast = frozen.parse(scn, false);
+    BOOST_CHECK(scn.status_ == expected_status);
+    BOOST_CHECK(scn.status_ == pointer_status);
+    BOOST_REQUIRE_EQUAL(bool(ast), bool(frozen_ast));
+    if (!ast)
+        return;
+
+    std::stringstream json, frozen_json;
+    ast->write_json(json);
+    frozen_ast->write_json(frozen_json);
+    BOOST_CHECK_EQUAL(json.str(), frozen_json.str());
+    BOOST_CHECK(ast->execute() == frozen_ast->execute());
+}
+
+// the optimized grammar must build the same ast as the frozen one
+void test_optimized(bool calls, std::string_view text, long expected) {
+    auto scn = onek::scan_state(text);
+    scn.symbols_ = &example::variables;
+    auto program = calls ? example::call_grammar(scn) : example::grammar(scn);
+    auto frozen = onek::frozen_grammar<example::F>(program.get());
+    auto optimized = frozen;
+    auto stats = onek::optimize(optimized);
+    BOOST_TEST_MESSAGE(stats);
+    BOOST_CHECK_EQUAL(stats.nodes_after, optimized.nodes().size());
+    BOOST_CHECK_LT(stats.nodes_after, stats.nodes_before);
+    BOOST_CHECK(stats.flattened > 0);
+    if (calls) {
+        BOOST_CHECK_EQUAL(stats.merged_literals, 2);
+        BOOST_CHECK_EQUAL(stats.factored, 1);
+    }
+
+    auto ast = frozen.parse(scn, false);
+    scn = onek::scan_state(text);
+    scn.symbols_ = &example::variables;
+    auto optimized_ast = optimized.parse(scn, false);
+    BOOST_REQUIRE(ast && optimized_ast);
+    std::stringstream json, optimized_json;
+    ast->write_json(json);
+    optimized_ast->write_json(optimized_json);
+    BOOST_CHECK_EQUAL(json.str(), optimized_json.str());
+    BOOST_CHECK_EQUAL(std::get<long>(optimized_ast->execute()), expected);
+    // productions the optimizer removes did not store nodes anyway
+    BOOST_CHECK_EQUAL(optimized_ast->memory_.size(), ast->memory_.size());
+}
+
+// clang-format off
+BOOST_AUTO_TEST_SUITE(frozen_grammar);
+BOOST_AUTO_TEST_CASE(same_ast)              { test_frozen("(1 + 2) * 3 - (4 * (0x5 - ALPHA))", onek::parse_status::ok); }
+BOOST_AUTO_TEST_CASE(same_failure)          { test_frozen("1 + 2 3", onek::parse_status::ok); }
+BOOST_AUTO_TEST_CASE(same_cut_failure)      { test_frozen("2 * (1 + ) - 3", onek::parse_status::cut_failure); }
+BOOST_AUTO_TEST_CASE(optimized)             { test_optimized(false, "(1 + 2) * 3 - (4 * (0x5 - 2))", -3); }
+BOOST_AUTO_TEST_CASE(optimized_calls)       { test_optimized(true, "f(1) + f[2] * 3 - 4", 5); }
+BOOST_AUTO_TEST_SUITE_END();
+// clang-format on
+
+// parsing the lexed text must build the same ast as parsing the text
+void test_lexer(std::string_view text, size_t expected_tokens) {
+    auto scn = onek::scan_state(text);
+    scn.symbols_ = &example::variables;
+    auto program = example::grammar(scn);
+    auto ast = program->parse(scn, nullptr, true);
+    BOOST_REQUIRE_MESSAGE(ast, std::string(text) + " did not compile");
+
+    scn = onek::scan_state(text);
+    scn.symbols_ = &example::variables;
+    auto tokens = onek::lexer<example::F>(program.get()).tokenize(scn);
+    BOOST_REQUIRE(tokens);
+    BOOST_CHECK_EQUAL(tokens->lexemes.size(), expected_tokens);
+    scn.tokens_ = &*tokens;
+    auto lexed_ast = program->parse(scn, nullptr, true);
+    BOOST_REQUIRE_MESSAGE(lexed_ast, std::string(text) + " did not compile in token mode");
+    BOOST_CHECK_EQUAL(scn.token_pos_, expected_tokens);
+
+    std::stringstream json, lexed_json;
+    ast->write_json(json);
+    lexed_ast->write_json(lexed_json);
+    BOOST_CHECK_EQUAL(json.str(), lexed_json.str());
+    BOOST_CHECK(ast->execute() == lexed_ast->execute());
+}
+
+void test_lexer_error(std::string_view text) {
+    auto scn = onek::scan_state(text);
+    auto program = example::grammar(scn);
+    BOOST_CHECK(!onek::lexer<example::F>(program.get()).tokenize(scn));
+    BOOST_CHECK(scn.p_ == text.begin());
+}
+
+// a terminal only takes lexemes its own scanner matched, not all of its token id
+void test_lexer_scanners(std::string_view text, std::optional<long> right_result) {
+    auto parse = [&](bool lexed) -> std::optional<long> {
+        auto scn = onek::scan_state(text);
+        auto program = example::hex_grammar(scn);
+        auto tokens = onek::lexer<example::F>(program.get()).tokenize(scn);
+        BOOST_REQUIRE(tokens);
+        if (lexed)
+            scn.tokens_ = &*tokens;
+        auto ast = program->parse(scn, nullptr, false);
+        return ast ? std::optional(std::get<long>(ast->execute())) : std::nullopt;
+    };
+    BOOST_CHECK(parse(false) == right_result);
+    BOOST_CHECK(parse(true) == right_result);
+}
+
+// clang-format off
+BOOST_AUTO_TEST_SUITE(lexer);
+BOOST_AUTO_TEST_CASE(same_ast)              { test_lexer(" (1 + 2) * 3 - (4 * (0x5 - ALPHA))", 17); }
+BOOST_AUTO_TEST_CASE(longest_match)         { test_lexer("-12 - 0x10", 3); }
+BOOST_AUTO_TEST_CASE(unknown_character)     { test_lexer_error("1 + $"); }
+BOOST_AUTO_TEST_CASE(scanner_of_token)      { test_lexer_scanners("0x10 2", 18); }
+BOOST_AUTO_TEST_CASE(other_scanner)         { test_lexer_scanners("12 3", std::nullopt); }
+BOOST_AUTO_TEST_SUITE_END();
+// clang-format on
+
+// the chunks are read from a pipe, which stands in for a socket
+void test_push_parser(std::string_view input, char separator, size_t chunk_size, std::vector<std::optional<long>> const &expected) {
+    int fds[2];
+    BOOST_REQUIRE(pipe(fds) == 0);
+    BOOST_REQUIRE(write(fds[1], input.data(), input.size()) == ssize_t(input.size()));
+    close(fds[1]);
+
+    auto scn = onek::scan_state("");
+    scn.symbols_ = &example::variables;
+    auto program = example::grammar(scn);
+    auto parser = onek::push_parser<example::F>::start(program.get(), scn, separator, false);
+    std::vector<char> buffer(chunk_size);
+    for (ssize_t n; (n = read(fds[0], buffer.data(), buffer.size())) > 0;)
+        parser.feed({buffer.data(), size_t(n)});
+    close(fds[0]);
+    parser.finish();
+    BOOST_CHECK(parser.done());
+
+    auto &results = parser.results();
+    BOOST_REQUIRE_EQUAL(results.size(), expected.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        BOOST_REQUIRE_EQUAL(bool(results[i]), bool(expected[i]));
+        if (expected[i])
+            BOOST_CHECK_EQUAL(std::get<long>(results[i]->execute()), *expected[i]);
+    }
+}
+
+// clang-format off
+BOOST_AUTO_TEST_SUITE(push_parser);
+BOOST_AUTO_TEST_CASE(one_unit)              { test_push_parser("(1 + 2) * (3 - 0x4)", 0, 3, {-3}); }
+BOOST_AUTO_TEST_CASE(units)                 { test_push_parser("1 + 2;(3;4) * 2; 5 * 5;", ';', 2, {3, std::nullopt, 25}); }
+BOOST_AUTO_TEST_CASE(single_bytes)          { test_push_parser("7 * 6;2 - 3", ';', 1, {42, -1}); }
+BOOST_AUTO_TEST_CASE(undeclared_brackets)   { test_push_parser("1 + 2;[3;4", ';', 2, {3, std::nullopt, 4}); }
+BOOST_AUTO_TEST_SUITE_END();
+// clang-format on
+
+void test_list(std::string_view text, bool trailing, std::optional<long> expected_sum) {
+    auto scn = onek::scan_state(text);
+    auto program = example::list_grammar(scn, trailing);
+    auto ast = program->parse(scn, nullptr, false);
+    BOOST_REQUIRE_EQUAL(bool(ast), bool(expected_sum));
+    if (ast)
+        BOOST_CHECK_EQUAL(std::get<long>(ast->execute()), *expected_sum);
+
+    // and the same with the frozen grammar
+    scn.reset(text);
+    auto frozen_ast = onek::frozen_grammar<example::F>(program.get()).parse(scn, false);
+    BOOST_REQUIRE_EQUAL(bool(frozen_ast), bool(expected_sum));
+    if (frozen_ast)
+        BOOST_CHECK_EQUAL(std::get<long>(frozen_ast->execute()), *expected_sum);
+}
+
+void test_long_list(size_t length) {
+    std::string text = "1";
+    for (size_t i = 1; i < length; ++i)
+        text += ", 1";
+    auto scn = onek::scan_state(text);
+    auto program = example::list_grammar(scn, false);
+    auto ast = program->parse(scn, nullptr, false);
+    BOOST_REQUIRE(ast);
+    auto *sum = ast->get_root_node()->first_child_;
+    BOOST_CHECK_EQUAL(sum->name_, "sum");
+    size_t children = 0;
+    for (auto const *child = sum->first_child_; child; child = child->next_sibbling_)
+        ++children;
+    BOOST_CHECK_EQUAL(children, length);
+    BOOST_CHECK_EQUAL(std::get<long>(ast->execute()), long(length));
+}
+
+void test_match_delimiter(std::string_view text, char const *delimiter, std::string_view rest) {
+    auto scn = onek::scan_state(text);
+    bool matched = scn.match_delimiter(delimiter);
+    BOOST_CHECK_EQUAL(matched, rest.data() != nullptr);
+    if (matched)
+        BOOST_CHECK_EQUAL(std::string_view(scn.p_, scn.scanner_end_), rest);
+    else
+        BOOST_CHECK(scn.p_ == text.begin());
+}
+
+// the text is read from a buffer of its exact size, without a null terminator
+void test_exact_buffer(std::string_view text, long right_result) {
+    auto buffer = std::make_unique<char[]>(text.size());
+    std::copy(text.begin(), text.end(), buffer.get());
+    auto exact = std::string_view(buffer.get(), text.size());
+    auto scn = onek::scan_state(exact);
+    auto program = example::list_grammar(scn, true);
+    auto ast = program->parse(scn, nullptr, false);
+    BOOST_REQUIRE(ast);
+    BOOST_CHECK_EQUAL(std::get<long>(ast->execute()), right_result);
+}
+
+// clang-format off
+BOOST_AUTO_TEST_SUITE(separated_list);
+BOOST_AUTO_TEST_CASE(items)                 { test_list("1, 2,3 , -4", false, 2); }
+BOOST_AUTO_TEST_CASE(single_item)           { test_list("5", false, 5); }
+BOOST_AUTO_TEST_CASE(no_trailing)           { test_list("1, 2,", false, std::nullopt); }
+BOOST_AUTO_TEST_CASE(trailing)              { test_list("1, 2,", true, 3); }
+BOOST_AUTO_TEST_CASE(double_separator)      { test_list("1,, 2", true, std::nullopt); }
+BOOST_AUTO_TEST_CASE(long_list)             { test_long_list(10000); }
+BOOST_AUTO_TEST_CASE(delimiter)             { test_match_delimiter(" ,x", ",", "x"); }
+BOOST_AUTO_TEST_CASE(delimiter_in_text)     { test_match_delimiter(", x", ", y", {}); }
+BOOST_AUTO_TEST_CASE(delimiter_bounded)     { test_match_delimiter(std::string_view("::", 1), "::", {}); }
+BOOST_AUTO_TEST_CASE(exact_buffer)          { test_exact_buffer("1, 2, 3", 6); }
+BOOST_AUTO_TEST_CASE(exact_buffer_trailing) { test_exact_buffer("1, 2, 3 ,", 6); }
+BOOST_AUTO_TEST_SUITE_END();
+// clang-format on
+
+void test_resources(std::string const &text, onek::resource_limits const &limits, char const *exceeded) {
+    auto scn = onek::scan_state(text);
+    auto program = example::grammar(scn);
+    auto handle = onek::arena_handle(program);
+    auto resources = onek::resource_guard(limits, handle);
+    scn.resources_ = &resources;
+    auto ast = program->parse(scn, nullptr, false);
+
+    auto const &report = resources.report();
+    BOOST_CHECK(report.arena_bytes > 0);
+    if (!exceeded) {
+        BOOST_REQUIRE_MESSAGE(ast, text + " did not compile");
+        BOOST_CHECK(scn.status_ == onek::parse_status::ok);
+        BOOST_CHECK(report.exceeded == nullptr);
+        BOOST_CHECK_EQUAL(report.nodes, ast->memory_.size());
+        BOOST_CHECK_EQUAL(report.ast_bytes, report.nodes * sizeof(example::N));
+        BOOST_CHECK(report.peak_depth > 0);
+        BOOST_CHECK(report.backtracks > 0);
+    } else {
+        BOOST_CHECK(!ast);
+        BOOST_CHECK(scn.status_ == onek::parse_status::limit_exceeded);
+        BOOST_REQUIRE(report.exceeded);
+        BOOST_CHECK_EQUAL(report.exceeded, exceeded);
+    }
+}
+
+std::string nested(size_t depth) { return std::string(depth, '(') + "1" + std::string(depth, ')'); }
+
+// the arena is watched while parsing, it grows once the ast is stored in it
+void test_arena_growth() {
+    std::string_view text = "(1 + 2) * 3";
+    auto scn = onek::scan_state(text);
+    auto program = example::grammar(scn);
+    auto nodes = onek::arena_handle();
+    nodes.set_destroy_arena_on_scope_exit();
+    scn.ast_memory_ = nodes.resource();
+    auto resources = onek::resource_guard({.max_arena_bytes = 1}, nodes);
+    scn.resources_ = &resources;
+    BOOST_CHECK_EQUAL(resources.report().arena_bytes, 0);
+    BOOST_CHECK(!program->parse(scn, nullptr, false));
+    BOOST_CHECK_EQUAL(resources.report().exceeded, "arena bytes");
+    BOOST_CHECK_EQUAL(resources.report().arena_bytes, nodes.reserved_bytes());
+    BOOST_CHECK(nodes.reserved_bytes() > 0);
+}
+
+// clang-format off
+BOOST_AUTO_TEST_SUITE(resource_limits);
+BOOST_AUTO_TEST_CASE(report)                { test_resources("(1 + 2) * 3", {}, nullptr); }
+BOOST_AUTO_TEST_CASE(nodes)                 { test_resources("(1 + 2) * 3", {.max_nodes = 5}, "nodes"); }
+BOOST_AUTO_TEST_CASE(ast_bytes)             { test_resources("(1 + 2) * 3", {.max_ast_bytes = 5 * sizeof(example::N)}, "ast bytes"); }
+BOOST_AUTO_TEST_CASE(arena_bytes)           { test_resources("(1 + 2) * 3", {.max_arena_bytes = 1}, "arena bytes"); }
+BOOST_AUTO_TEST_CASE(arena_growth)          { test_arena_growth(); }
+BOOST_AUTO_TEST_CASE(backtracks)            { test_resources("(1 + 2) * 3", {.max_backtracks = 0}, "backtracks"); }
+BOOST_AUTO_TEST_CASE(depth)                 { test_resources(nested(1000), {.max_depth = 100}, "depth"); }
+BOOST_AUTO_TEST_CASE(depth_within_limit)    { test_resources(nested(10), {.max_depth = 100}, nullptr); }
+BOOST_AUTO_TEST_SUITE_END();
+// clang-format on
+
+void test_split_points(std::string_view text, std::vector<size_t> const &expected, std::string_view brackets = "()[]{}") {
+    auto points = onek::detail::split_points(text, ';', brackets);
+    BOOST_CHECK_EQUAL_COLLECTIONS(points.begin(), points.end(), expected.begin(), expected.end());
+}
+
+// unit i is "i * 2 + (1)" or ill formed
+void test_parallel(size_t units, unsigned threads, std::optional<size_t> bad_unit) {
+    std::string text;
+    long expected = 0;
+    for (size_t i = 0; i < units; ++i) {
+        text += i == bad_unit ? "1 +" : std::to_string(i) + " * 2 + (1)";
+        text += i % 3 ? ";" : ";\n";
+        expected += long(i) * 2 + 1;
+    }
+    auto make_grammar = [](onek::scan_state &scn) { return onek::separate_units(example::grammar(scn), ';'); };
+    auto ast = onek::parse_parallel(text, make_grammar, example::sum_action, "units", threads);
+    BOOST_REQUIRE_EQUAL(bool(ast), !bad_unit);
+    if (!ast)
+        return;
+
+    auto *root = ast->get_root_node();
+    BOOST_CHECK_EQUAL(root->name_, "units");
+    size_t children = 0;
+    for (auto const *child = root->first_child_; child; child = child->next_sibbling_)
+        ++children;
+    BOOST_CHECK_EQUAL(children, units);
+    BOOST_CHECK_EQUAL(std::get<long>(ast->execute()), expected);
+}
+
+// clang-format off
+BOOST_AUTO_TEST_SUITE(parallel_parse);
+BOOST_AUTO_TEST_CASE(split_points)          { test_split_points("a;(b;c);d", {1, 7}); }
+BOOST_AUTO_TEST_CASE(split_points_long)     { test_split_points("0123456789;(23456789;12345)7;9012345[;]89{0;}2;", {10, 28, 46}); }
+BOOST_AUTO_TEST_CASE(split_points_pairs)    { test_split_points("a;[b;c];(d;e)", {1, 4, 7}, "()"); }
+BOOST_AUTO_TEST_CASE(split_points_angle)    { test_split_points("0123456789;<23456789;12345>7;9012345(;)89", {10, 28, 37}, "<>"); }
+BOOST_AUTO_TEST_CASE(in_order)              { test_parallel(3000, 4, std::nullopt); }
+BOOST_AUTO_TEST_CASE(single_thread)         { test_parallel(100, 1, std::nullopt); }
+BOOST_AUTO_TEST_CASE(failing_unit)          { test_parallel(500, 4, 321); }
+BOOST_AUTO_TEST_SUITE_END();
+// clang-format on
+
+void test_hash_cons(std::string_view text, size_t expected_unique) {
+    auto scn = onek::scan_state(text);
+    auto program = example::grammar(scn);
+    auto ast = program->parse(scn, nullptr, true);
+    BOOST_REQUIRE_MESSAGE(ast, std::string(text) + " did not compile");
+
+    example::arithmetic_op_calls = 0;
+    auto result = ast->execute();
+    auto calls = example::arithmetic_op_calls;
+
+    auto stats = onek::hash_cons(*ast);
+    BOOST_CHECK_EQUAL(stats.unique, expected_unique);
+    BOOST_CHECK(stats.unique < stats.nodes);
+    example::arithmetic_op_calls = 0;
+    BOOST_CHECK(ast->execute() == result);
+    BOOST_CHECK(example::arithmetic_op_calls < calls);
+
+    // the cache lives for one execute only
+    example::arithmetic_op_calls = 0;
+    ast->execute();
+    BOOST_CHECK(example::arithmetic_op_calls < calls);
+    BOOST_CHECK(example::arithmetic_op_calls > 0);
+}
+
+// clang-format off
+BOOST_AUTO_TEST_SUITE(hash_consing);
+BOOST_AUTO_TEST_CASE(common_subexpressions) { test_hash_cons("(1 + 2) * (1 + 2) - (1 + 2) * (1 + 2)", 12); }
+BOOST_AUTO_TEST_SUITE_END();
+// clang-format on
+
+void test_incremental(std::string_view text, char const *variable) {
+    example::variables.set("GAMMA", 2);
+    example::variables.set("DELTA", 3);
+    auto scn = onek::scan_state(text);
+    scn.symbols_ = &example::variables;
+    auto program = example::grammar(scn);
+    auto ast = program->parse(scn, nullptr, true);
+    BOOST_REQUIRE_MESSAGE(ast, std::string(text) + " did not compile");
+
+    auto evaluator = onek::incremental_evaluator<example::F>(ast->get_root_node());
+    BOOST_CHECK(evaluator.evaluate() == ast->execute());
+    auto const all = evaluator.recomputed();
+    BOOST_CHECK(all > 0);
+    BOOST_CHECK(evaluator.evaluate() == ast->execute());
+    BOOST_CHECK_EQUAL(evaluator.recomputed(), 0);
+
+    for (long value : {5, -3, 10}) {
+        auto id = example::variables.set(variable, value);
+        BOOST_CHECK(evaluator.reads(id));
+        evaluator.changed(id);
+        BOOST_CHECK(evaluator.evaluate() == ast->execute());
+        BOOST_CHECK(evaluator.recomputed() > 0);
+        BOOST_CHECK(evaluator.recomputed() < all);
+    }
+}
+
+// clang-format off
+BOOST_AUTO_TEST_SUITE(incremental);
+BOOST_AUTO_TEST_CASE(first_operand)         { test_incremental("GAMMA * 2 + (3 + 4) * (5 - 1) - DELTA", "GAMMA"); }
+BOOST_AUTO_TEST_CASE(last_operand)          { test_incremental("GAMMA * 2 + (3 + 4) * (5 - 1) - DELTA", "DELTA"); }
+BOOST_AUTO_TEST_CASE(repeated)              { test_incremental("(GAMMA - 1) * (GAMMA + 1) + DELTA", "GAMMA"); }
+BOOST_AUTO_TEST_SUITE_END();
+// clang-format on
+
+void test_budget(std::string const &text, onek::budget_limits const &limits, bool cancel, onek::parse_status expected_status, char const *exhausted) {
+    auto scn = onek::scan_state(text);
+    auto program = example::grammar(scn);
+    auto stop = std::stop_source();
+    if (cancel)
+        stop.request_stop();
+    auto budget = onek::parse_budget(limits, stop.get_token());
+    scn.budget_ = &budget;
+    auto ast = program->parse(scn, nullptr, false);
+
+    BOOST_CHECK(scn.status_ == expected_status);
+    BOOST_CHECK(budget.steps() > 0);
+    if (!exhausted) {
+        BOOST_CHECK(ast);
+        BOOST_CHECK(budget.exhausted() == nullptr);
+        return;
+    }
+    BOOST_CHECK(!ast);
+    BOOST_REQUIRE(budget.exhausted());
+    BOOST_CHECK_EQUAL(budget.exhausted(), exhausted);
+    BOOST_CHECK(strcmp(budget.stopped_in(), "unknown") != 0);
+}
+
+// clang-format off
+BOOST_AUTO_TEST_SUITE(parse_budget);
+BOOST_AUTO_TEST_CASE(within_budget)         { test_budget("(1 + 2) * 3", {.max_steps = 1000}, false, onek::parse_status::ok, nullptr); }
+BOOST_AUTO_TEST_CASE(steps)                 { test_budget(nested(200), {.max_steps = 1000}, false, onek::parse_status::budget_exceeded, "steps"); }
+BOOST_AUTO_TEST_CASE(rescanned_bytes)       { test_budget("1 * (2 + 3) * 4 + 5 *", {.max_rescanned_bytes = 0}, false, onek::parse_status::budget_exceeded, "rescanned bytes"); }
+BOOST_AUTO_TEST_CASE(deadline)              { test_budget("(1 + 2) * 3", {.max_time = std::chrono::nanoseconds(0)}, false, onek::parse_status::budget_exceeded, "deadline"); }
+BOOST_AUTO_TEST_CASE(cancelled)             { test_budget("(1 + 2) * 3", {}, true, onek::parse_status::cancelled, "cancelled"); }
+BOOST_AUTO_TEST_SUITE_END();
+// clang-format on
+
+void test_arena_backend(onek::arena_backend backend, unsigned threads) {
+    auto work = [backend](long n) {
+        auto text = std::to_string(n) + " * (2 + 3) - 1";
+        auto scn = onek::scan_state(text);
+        auto program = example::grammar(scn, backend);
+        auto nodes = onek::arena_handle(backend);
+        scn.ast_memory_ = nodes.resource();
+        auto ast = program->parse(scn, nullptr, false);
+        // no boost test macros on other threads
+        return ast && ast->memory_.get_allocator().resource() == nodes.resource() && std::get<long>(ast->execute()) == n * 5 - 1;
+    };
+    std::vector<std::future<bool>> results;
+    for (unsigned t = 0; t < threads; ++t)
+        results.push_back(std::async(std::launch::async, work, long(t)));
+    for (auto &result : results)
+        BOOST_CHECK(result.get());
+}
+
+// per thread arenas belong to their handle, not to the thread that created them
+void test_arena_outlives_thread() {
+    std::string_view text = "1 * (2 + 3) - 1";
+    auto scn = onek::scan_state(text);
+    auto program = std::async(std::launch::async, [&scn]() { return example::grammar(scn, onek::arena_backend::per_thread); }).get();
+    auto ast = program->parse(scn, nullptr, false);
+    BOOST_REQUIRE(ast);
+    BOOST_CHECK_EQUAL(std::get<long>(ast->execute()), 4);
+    for (int i = 0; i < 3; ++i) {
+        auto nodes = onek::arena_handle(onek::arena_backend::per_thread);
+        nodes.set_destroy_arena_on_scope_exit();
+        scn.reset(text);
+        scn.ast_memory_ = nodes.resource();
+        BOOST_CHECK(program->parse(scn, nullptr, false));
+    }
+    scn.ast_memory_ = nullptr;
+    auto handle = onek::arena_handle(program);
+    handle.set_destroy_arena_on_scope_exit();
+}
+
+// clang-format off
+BOOST_AUTO_TEST_SUITE(arena_backends);
+BOOST_AUTO_TEST_CASE(heap)                  { test_arena_backend(onek::arena_backend::heap, 1); }
+BOOST_AUTO_TEST_CASE(huge_pages)            { test_arena_backend(onek::arena_backend::huge_pages, 1); }
+BOOST_AUTO_TEST_CASE(per_thread)            { test_arena_backend(onek::arena_backend::per_thread, 4); }
+BOOST_AUTO_TEST_CASE(outlives_thread)       { test_arena_outlives_thread(); }
+BOOST_AUTO_TEST_SUITE_END();
+// clang-format on
+
+// counts the allocations of the ast memory
+struct counting_resource : std::pmr::memory_resource {
+    size_t allocations = 0;
+    void *do_allocate(size_t bytes, size_t alignment) override {
+        ++allocations;
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+    void do_deallocate(void *p, size_t bytes, size_t alignment) override { std::pmr::new_delete_resource()->deallocate(p, bytes, alignment); }
+    bool do_is_equal(memory_resource const &other) const noexcept override { return this == &other; }
+};
+
+void test_recognize(std::string const &text) {
+    auto parsed = [&]() {
+        auto scn = onek::scan_state(text);
+        auto program = example::grammar(scn);
+        return bool(program->parse(scn, nullptr, false));
+    }();
+    auto scn = onek::scan_state(text);
+    auto program = example::grammar(scn);
+    counting_resource memory;
+    auto *outer = std::pmr::set_default_resource(&memory);
+    bool recognized = program->recognize(scn, false);
+    std::pmr::set_default_resource(outer);
+    BOOST_CHECK_EQUAL(recognized, parsed);
+
+    // an empty deque allocates its map, nothing else is allocated for the tree
+    counting_resource empty;
+    { std::pmr::deque<example::N> nodes(&empty); }
+    BOOST_CHECK_EQUAL(memory.allocations, empty.allocations);
+}
+
+void test_events(bool optional, std::string const &text, char const *expected) {
+    auto scn = onek::scan_state(text);
+    auto program = optional ? example::optional_grammar(scn) : example::grammar(scn);
+    std::string events;
+    auto callbacks = onek::parse_events{
+            .enter = [&](char const *production) { events += std::string(production) + "( "; },
+            .exit = [&](char const *) { events += ") "; },
+            .token = [&](onek::token_id id, std::string_view text, onek::token_value const &) {
+                if (id != onek::token_id::the_end)
+                    events += std::string(text) + " ";
+            }};
+    BOOST_CHECK(program->parse(scn, callbacks, false));
+    BOOST_CHECK_EQUAL(events, expected);
+}
+
+// clang-format off
+BOOST_AUTO_TEST_SUITE(parse_modes);
+BOOST_AUTO_TEST_CASE(recognize_valid)       { test_recognize("1 * (2 + 3) * 4 + 5"); }
+BOOST_AUTO_TEST_CASE(recognize_nested)      { test_recognize(nested(100)); }
+BOOST_AUTO_TEST_CASE(recognize_invalid)     { test_recognize("1 * (2 + 3) * 4 + 5 *"); }
+BOOST_AUTO_TEST_CASE(events_backtracking)   { test_events(true, "1", "program( 1 ) "); }
+BOOST_AUTO_TEST_CASE(events_optional)       { test_events(true, "1 + 2", "program( pair( 1 + ) 2 ) "); }
+BOOST_AUTO_TEST_CASE(events_expression)     { test_events(false, "2 * (3)", "program( expression( term( unsigned factor( 2 ) * term( unsigned factor( sub( ( expression( term( unsigned factor( 3 ) ) ) ) ) ) ) ) ) ) "); }
+BOOST_AUTO_TEST_SUITE_END();
+// clang-format on
+
+// an iteration of a repetition that matches only partly gives back what it matched
+void test_partial_iteration(std::string const &text, bool matches) {
+    auto scn = onek::scan_state(text);
+    auto program = example::optional_grammar(scn, true);
+    BOOST_CHECK_EQUAL(bool(program->parse(scn, nullptr, false)), matches);
+}
+
+// clang-format off
+BOOST_AUTO_TEST_SUITE(repetition);
+BOOST_AUTO_TEST_CASE(partial_iteration)     { test_partial_iteration("1 + 2 + 3", true); }
+BOOST_AUTO_TEST_CASE(no_partial_iteration)  { test_partial_iteration("3", true); }
+BOOST_AUTO_TEST_CASE(missing_last)          { test_partial_iteration("1 + 2 +", false); }
+BOOST_AUTO_TEST_SUITE_END();
+// clang-format on
+
+// the source texts of the nodes a query finds, separated by '|'
+void test_query(std::string const &text, onek::ast_query const &query, std::string const &expected) {
+    auto scn = onek::scan_state(text);
+    auto program = example::grammar(scn);
+    auto ast = program->parse(scn, nullptr, true);
+    BOOST_REQUIRE_MESSAGE(ast, text + " did not compile");
+    auto index = onek::ast_index<example::F>(*ast, text);
+
+    std::string found;
+    for (auto const *node : index.find(query)) {
+        auto [begin, end] = index.extent(node);
+        found += (found.empty() ? "" : "|") + text.substr(begin, end - begin);
+        BOOST_CHECK(index.at(begin) == node || index.is_ancestor(node, index.at(begin)));
+    }
+    BOOST_CHECK_EQUAL(found, expected);
+}
+
+void test_offset(std::string const &text, size_t offset, char const *expected_name, std::string const &expected_text) {
+    auto scn = onek::scan_state(text);
+    auto program = example::grammar(scn);
+    auto ast = program->parse(scn, nullptr, true);
+    BOOST_REQUIRE_MESSAGE(ast, text + " did not compile");
+    auto index = onek::ast_index<example::F>(*ast, text);
+
+    auto const *node = index.at(offset);
+    BOOST_REQUIRE(node);
+    BOOST_CHECK_EQUAL(node->name_, expected_name);
+    auto [begin, end] = index.extent(node);
+    BOOST_CHECK_EQUAL(text.substr(begin, end - begin), expected_text);
+    BOOST_CHECK_EQUAL(index.named(expected_name).empty(), false);
+}
+
+// clang-format off
+BOOST_AUTO_TEST_SUITE(ast_index);
+BOOST_AUTO_TEST_CASE(by_name)               { test_query("1 * (2 + 3) / 4 - 6", {.production = "term"}, "1 * (2 + 3) / 4|2|3|6"); }
+BOOST_AUTO_TEST_CASE(under)                 { test_query("1 * (2 + 3) / 4 - 6", {.production = "term", .under = "term"}, "2|3"); }
+BOOST_AUTO_TEST_CASE(containing)            { test_query("1 * (2 + 3) / 4 - 6 / 2", {.production = "term", .under = "expression", .containing = onek::token_id::func, .text = "/"}, "1 * (2 + 3) / 4|6 / 2"); }
+BOOST_AUTO_TEST_CASE(containing_text)       { test_query("1 * (2 + 3) / 4 - 6 / 2", {.production = "term", .containing = onek::token_id::func, .text = "+"}, "1 * (2 + 3) / 4"); }
+BOOST_AUTO_TEST_CASE(innermost_token)       { test_offset("1 * (2 + 3) / 4", 5, "int_number", "2"); }
+BOOST_AUTO_TEST_CASE(innermost_production)  { test_offset("1 * (2 + 3) / 4", 6, "expression", "2 + 3"); }
+BOOST_AUTO_TEST_SUITE_END();
+// clang-format on
+
+std::vector<std::string> generate(onek::generator_options const &options, size_t count) {
+    std::string_view const text = "1 + 2";
+    auto symbols = onek::intern_table();
+    auto scn = onek::scan_state(text);
+    scn.symbols_ = &symbols;
+    auto program = example::grammar(scn);
+    auto generator = onek::sentence_generator<example::F>(program.get(), scn, options);
+    std::vector<std::string> sentences;
+    for (size_t k = 0; k < count; ++k) {
+        auto sentence = generator.sentence();
+        BOOST_REQUIRE(sentence);
+        sentences.push_back(*sentence);
+    }
+    // the scan state of the caller is left as it was
+    BOOST_CHECK(scn.p_ == text.begin() && scn.scanner_end_ == text.end());
+    BOOST_CHECK(scn.symbols_ == &symbols);
+    BOOST_CHECK_EQUAL(symbols.size(), 0);
+
+    // and each of them is accepted by the grammar it was generated from
+    for (auto const &sentence : sentences) {
+        scn.reset(sentence);
+        BOOST_CHECK_MESSAGE(program->recognize(scn, false), sentence);
+    }
+    return sentences;
+}
+
+// the sums of the grammar are right recursive, so long sentences need a high depth
+void test_generator(size_t target_size, size_t max_depth) {
+    auto sentences = generate({.seed = 7, .target_size = target_size, .max_depth = max_depth}, 50);
+    BOOST_CHECK(sentences == generate({.seed = 7, .target_size = target_size, .max_depth = max_depth}, 50));
+    BOOST_CHECK(sentences != generate({.seed = 8, .target_size = target_size, .max_depth = max_depth}, 50));
+
+    size_t total = 0;
+    for (auto const &sentence : sentences)
+        total += sentence.size();
+    BOOST_CHECK_GT(total / sentences.size(), target_size / 4);
+}
+
+void test_generator_weights() {
+    bool brackets = false;
+    for (auto const &sentence : generate({.seed = 1, .target_size = 200}, 20))
+        brackets = brackets || sentence.find('(') != std::string::npos;
+    BOOST_CHECK(brackets);
+    for (auto const &sentence : generate({.seed = 1, .target_size = 200, .weights = {{"sub", 0}}}, 20))
+        BOOST_CHECK_MESSAGE(sentence.find('(') == std::string::npos, sentence);
+}
+
+// clang-format off
+BOOST_AUTO_TEST_SUITE(sentence_generator);
+BOOST_AUTO_TEST_CASE(short_sentences)       { test_generator(20, 16); }
+BOOST_AUTO_TEST_CASE(long_sentences)        { test_generator(200, 200); }
+BOOST_AUTO_TEST_CASE(weights)               { test_generator_weights(); }
+BOOST_AUTO_TEST_SUITE_END();
+// clang-format on
+
+// only action parents and terminals are stored: the tree and the brackets and delimiters
+void test_materialized(std::string const &text, bool list) {
+    auto scn = onek::scan_state(text);
+    auto program = list ? example::list_grammar(scn, false) : example::grammar(scn);
+    auto ast = program->parse(scn, nullptr, true);
+    BOOST_REQUIRE_MESSAGE(ast, text + " did not compile");
+
+    size_t in_tree = 0;
+    std::vector<example::N const *> todo{ast->get_root_node()};
+    while (!todo.empty()) {
+        auto const *n = todo.back();
+        todo.pop_back();
+        ++in_tree;
+        for (auto const *c = n->first_child_; c; c = c->next_sibbling_)
+            todo.push_back(c);
+    }
+    size_t unattached = 0;
+    for (auto const &n : ast->memory_) {
+        BOOST_CHECK(n.token_id_ != onek::token_id::composed || (n.flags & onek::FLAG_ACTION_PARENT));
+        unattached += n.token_id_ == onek::token_id::open || n.token_id_ == onek::token_id::close || n.token_id_ == onek::token_id::delimiter;
+    }
+    BOOST_CHECK_EQUAL(ast->memory_.size(), in_tree + unattached);
+}
+
+// clang-format off
+BOOST_AUTO_TEST_SUITE(materialization);
+BOOST_AUTO_TEST_CASE(expression)            { test_materialized("1 * (2 + 3) * 4 + 5", false); }
+BOOST_AUTO_TEST_CASE(list)                  { test_materialized("1, 2, 3, 4", true); }
+BOOST_AUTO_TEST_SUITE_END();
+// clang-format on
+
+// the same result with and without the bracket index, unbalanced text is rejected before the first production
+void test_brackets(std::string const &text, bool balanced) {
+    auto parse = [&](bool indexed) -> std::optional<long> {
+        auto scn = onek::scan_state(text);
+        auto program = example::grammar(scn);
+        auto brackets = onek::bracket_index(text, onek::declared_brackets<example::F>(program.get()));
+        auto budget = onek::parse_budget(onek::budget_limits{});
+        scn.budget_ = &budget;
+        if (indexed)
+            scn.brackets_ = &brackets;
+        auto ast = program->parse(scn, nullptr, false);
+        if (indexed && !balanced) {
+            BOOST_CHECK(scn.status_ == onek::parse_status::unbalanced);
+            BOOST_CHECK_EQUAL(budget.steps(), 0);
+        }
+        return ast ? std::optional(std::get<long>(ast->execute())) : std::nullopt;
+    };
+    BOOST_CHECK_EQUAL(onek::bracket_index(text, "()").balanced(), balanced);
+    BOOST_CHECK(parse(true) == parse(false));
+}
+
+void test_bracket_pairs() {
+    std::string_view text = "f(1) + [2 * (3 + {4})] - (5)";
+    auto brackets = onek::bracket_index(text);
+    BOOST_REQUIRE(brackets.balanced());
+    BOOST_CHECK_EQUAL(brackets.pairs().size(), 5);
+    for (auto const &p : brackets.pairs()) {
+        BOOST_CHECK_EQUAL(brackets.partner(p.open), p.close);
+        BOOST_CHECK_EQUAL(brackets.partner(p.close), p.open);
+    }
+    BOOST_CHECK_EQUAL(brackets.partner(7), 21);// [ ... ]
+    BOOST_CHECK_EQUAL(brackets.outer_end(19), 20);// {4} is in (3 + {4})
+    BOOST_CHECK_EQUAL(brackets.outer_end(21), text.size());
+    BOOST_CHECK_EQUAL(brackets.partner(0), onek::bracket_index::npos);
+
+    BOOST_CHECK_EQUAL(onek::bracket_index("(1 + [2)]").error(), 7);
+    BOOST_CHECK_EQUAL(onek::bracket_index("((1 + 2)").error(), 0);
+    BOOST_CHECK_EQUAL(onek::bracket_index("1 + 2)").error(), 5);
+    BOOST_CHECK_EQUAL(onek::bracket_index("(1 + [2)]", "()").error(), onek::bracket_index::npos);
+}
+
+// a frozen grammar with two kinds of brackets, alternatives fail inside a pair
+void test_frozen_brackets(std::string const &text, long right_result) {
+    auto scn = onek::scan_state(text);
+    auto program = example::call_grammar(scn);
+    auto frozen = onek::frozen_grammar<example::F>(program.get());
+    auto declared = onek::declared_brackets<example::F>(program.get());
+    BOOST_CHECK_EQUAL(declared, "()[]");
+    auto brackets = onek::bracket_index(text, declared);
+    scn.brackets_ = &brackets;
+    auto ast = frozen.parse(scn, true);
+    BOOST_REQUIRE_MESSAGE(ast, text + " did not compile");
+    BOOST_CHECK_EQUAL(std::get<long>(ast->execute()), right_result);
+}
+
+// clang-format off
+BOOST_AUTO_TEST_SUITE(bracket_index);
+BOOST_AUTO_TEST_CASE(pairs)                 { test_bracket_pairs(); }
+BOOST_AUTO_TEST_CASE(balanced)              { test_brackets("1 * (2 + 3) * 4 + 5", true); }
+BOOST_AUTO_TEST_CASE(several)               { test_brackets("((1 + 2) * (3 - 4)) / 5 + (6 * (7 + (8)))", true); }
+BOOST_AUTO_TEST_CASE(deep)                  { test_brackets(nested(100), true); }
+BOOST_AUTO_TEST_CASE(invalid_inside)        { test_brackets("(1 + ) * 2", true); }
+BOOST_AUTO_TEST_CASE(missing_close)         { test_brackets("(1 + 2 * (3 + 4)", false); }
+BOOST_AUTO_TEST_CASE(missing_open)          { test_brackets("1 + 2) * 3", false); }
+BOOST_AUTO_TEST_CASE(frozen)                { test_frozen_brackets("f(1) + f[2] * f( 3 ) - 4", 5); }
 BOOST_AUTO_TEST_SUITE_END();
 // clang-format on